@@ -433,6 +433,7 @@ int table_is_an_array(lua_State *L) {
     /* Stack top on function entry */
     int stacktop;
 
+    luaL_checkstack(L, 2, "in function table_is_an_array");
     stacktop = lua_gettop(L);
 
     lua_pushnil(L);
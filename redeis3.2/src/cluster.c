@@ -471,6 +471,10 @@ void clusterInit(void) {
         server.cluster->stats_bus_messages_received[i] = 0;
     }
     server.cluster->stats_pfail_nodes = 0;
+    server.cluster->stats_bus_bytes_sent = 0;
+    server.cluster->stats_bus_bytes_received = 0;
+    server.cluster->stats_bus_compact_sent = 0;
+    server.cluster->stats_bus_compact_received = 0;
     memset(server.cluster->slots,0, sizeof(server.cluster->slots));
     clusterCloseAllSlots();
 
@@ -523,10 +527,9 @@ void clusterInit(void) {
         }
     }
 
-    /* The slots -> keys map is a radix tree. Initialize it here. */
-    server.cluster->slots_to_keys = raxNew();
-    memset(server.cluster->slots_keys_count,0,
-           sizeof(server.cluster->slots_keys_count));
+    /* Only DB 0 is used in cluster mode, so it is the only one with a
+     * slots -> keys map. */
+    slotToKeyInit(server.db);
 
     /* Set myself->port / cport to my listening ports, we'll just need to
      * discover the IP address via MEET messages. */
@@ -616,6 +619,9 @@ clusterLink *createClusterLink(clusterNode *node) {
     link->rcvbuf = sdsempty();
     link->node = node;
     link->conn = NULL;
+    link->compact = 0;
+    link->slots_sent = NULL;
+    link->slots_received = NULL;
     return link;
 }
 
@@ -629,6 +635,8 @@ void freeClusterLink(clusterLink *link) {
     }
     sdsfree(link->sndbuf);
     sdsfree(link->rcvbuf);
+    zfree(link->slots_sent);
+    zfree(link->slots_received);
     if (link->node)
         link->node->link = NULL;
     zfree(link);
@@ -2271,6 +2279,140 @@ void clusterLinkConnectHandler(connection *conn) {
             node->name, node->ip, node->cport);
 }
 
+/* Return the value of the lowercase hex digit 'c', or -1 if it is not one.
+ * Node names are generated as lowercase hex strings, so the compact messages
+ * send them as binary: see clusterBuildCompactPing(). */
+static int clusterHexDigitValue(char c) {
+    if (c >= '0' && c <= '9') return c-'0';
+    if (c >= 'a' && c <= 'f') return c-'a'+10;
+    return -1;
+}
+
+/* Called for every packet received before clusterProcessPacket(). Compact
+ * PING/PONG messages are converted back into a full clusterMsg replacing
+ * link->rcvbuf, and the slots bitmap of every PING/PONG is remembered, since
+ * the next compact message on this link is encoded against it.
+ *
+ * Returns C_ERR if the compact message is not valid or can't be decoded: the
+ * caller should drop the link, the next one will start with full messages. */
+int clusterPreprocessPacket(clusterLink *link) {
+    clusterMsg *hdr = (clusterMsg*) link->rcvbuf;
+    uint32_t totlen = ntohl(hdr->totlen);
+    uint16_t type = ntohs(hdr->type);
+    uint16_t count = ntohs(hdr->count);
+
+    if (type != CLUSTERMSG_TYPE_PING && type != CLUSTERMSG_TYPE_PONG &&
+        type != CLUSTERMSG_TYPE_MEET)
+    {
+        if (memcmp(hdr->sig,"RCmc",4) == 0) return C_ERR;
+        return C_OK;
+    }
+    if (ntohs(hdr->ver) != CLUSTER_PROTO_VER) {
+        /* Messages of other versions are discarded anyway. */
+        return memcmp(hdr->sig,"RCmc",4) == 0 ? C_ERR : C_OK;
+    }
+
+    if (memcmp(hdr->sig,"RCmb",4) == 0) {
+        /* Full message: just take a copy of the bitmap if the message is
+         * valid, that is, if it is going to be processed. */
+        if (totlen != CLUSTERMSG_MIN_LEN+sizeof(clusterMsgDataGossip)*count)
+            return C_OK;
+        link->compact = (hdr->mflags[0] & CLUSTERMSG_FLAG0_COMPACT) != 0;
+        if (link->slots_received == NULL)
+            link->slots_received = zmalloc(sizeof(hdr->myslots));
+        memcpy(link->slots_received,hdr->myslots,sizeof(hdr->myslots));
+        return C_OK;
+    }
+
+    /* Compact message. */
+    clusterMsgCompact *chdr = (clusterMsgCompact*) link->rcvbuf;
+    unsigned char *p = chdr->data;
+    unsigned char *end = (unsigned char*)link->rcvbuf + totlen;
+    size_t slotslen = ntohs(chdr->slotslen);
+    int j;
+
+    if (link->slots_received == NULL) return C_ERR;
+    if (slotslen > (size_t)(end-p)) return C_ERR;
+
+    sds full = sdsnewlen(NULL,
+        CLUSTERMSG_MIN_LEN+sizeof(clusterMsgDataGossip)*count);
+    hdr = (clusterMsg*) full;
+    memcpy(hdr->sig,"RCmb",4);
+    hdr->totlen = htonl(sdslen(full));
+    hdr->ver = chdr->ver;
+    hdr->port = chdr->port;
+    hdr->type = chdr->type;
+    hdr->count = chdr->count;
+    hdr->currentEpoch = chdr->currentEpoch;
+    hdr->configEpoch = chdr->configEpoch;
+    hdr->offset = chdr->offset;
+    memcpy(hdr->sender,chdr->sender,CLUSTER_NAMELEN);
+    memcpy(hdr->slaveof,chdr->slaveof,CLUSTER_NAMELEN);
+    memcpy(hdr->myip,chdr->myip,NET_IP_STR_LEN);
+    hdr->cport = chdr->cport;
+    hdr->flags = chdr->flags;
+    hdr->state = chdr->state;
+    memcpy(hdr->mflags,chdr->mflags,sizeof(hdr->mflags));
+
+    /* Rebuild the slots bitmap. */
+    memcpy(hdr->myslots,link->slots_received,sizeof(hdr->myslots));
+    if (chdr->slotsenc == CLUSTERMSG_SLOTS_SAME) {
+        if (slotslen != 0) goto err;
+    } else if (chdr->slotsenc == CLUSTERMSG_SLOTS_DELTA) {
+        if (slotslen % 4) goto err;
+        for (size_t i = 0; i < slotslen; i += 4) {
+            uint16_t start, stop;
+            memcpy(&start,p+i,2);
+            memcpy(&stop,p+i+2,2);
+            start = ntohs(start);
+            stop = ntohs(stop);
+            if (start > stop || stop >= CLUSTER_SLOTS) goto err;
+            for (j = start; j <= stop; j++)
+                hdr->myslots[j/8] ^= 1<<(j&7);
+        }
+    } else if (chdr->slotsenc == CLUSTERMSG_SLOTS_FULL) {
+        if (slotslen != sizeof(hdr->myslots)) goto err;
+        memcpy(hdr->myslots,p,slotslen);
+    } else {
+        goto err;
+    }
+    p += slotslen;
+
+    /* Unpack the gossip sections. */
+    for (j = 0; j < count; j++) {
+        clusterMsgDataGossip *g = &hdr->data.ping.gossip[j];
+        size_t iplen;
+
+        if (end-p < CLUSTERMSG_COMPACT_GOSSIP_LEN) goto err;
+        iplen = p[34];
+        if (iplen >= NET_IP_STR_LEN ||
+            (size_t)(end-p) < CLUSTERMSG_COMPACT_GOSSIP_LEN+iplen) goto err;
+        for (int i = 0; i < CLUSTER_NAMELEN/2; i++) {
+            g->nodename[i*2] = "0123456789abcdef"[p[i]>>4];
+            g->nodename[i*2+1] = "0123456789abcdef"[p[i]&15];
+        }
+        memcpy(&g->ping_sent,p+20,4);
+        memcpy(&g->pong_received,p+24,4);
+        memcpy(&g->port,p+28,2);
+        memcpy(&g->cport,p+30,2);
+        memcpy(&g->flags,p+32,2);
+        memcpy(g->ip,p+CLUSTERMSG_COMPACT_GOSSIP_LEN,iplen);
+        p += CLUSTERMSG_COMPACT_GOSSIP_LEN+iplen;
+    }
+    if (p != end) goto err;
+
+    link->compact = (hdr->mflags[0] & CLUSTERMSG_FLAG0_COMPACT) != 0;
+    memcpy(link->slots_received,hdr->myslots,sizeof(hdr->myslots));
+    sdsfree(link->rcvbuf);
+    link->rcvbuf = full;
+    server.cluster->stats_bus_compact_received++;
+    return C_OK;
+
+err:
+    sdsfree(full);
+    return C_ERR;
+}
+
 /* Read data. Try to read the first field of the header first to check the
  * full length of the packet. When a whole packet is in memory this function
  * will call the function to process the packet. And so forth. */
@@ -2293,8 +2435,11 @@ void clusterReadHandler(connection *conn) {
             if (rcvbuflen == 8) {
                 /* Perform some sanity check on the message signature
                  * and length. */
-                if (memcmp(hdr->sig,"RCmb",4) != 0 ||
-                    ntohl(hdr->totlen) < CLUSTERMSG_MIN_LEN)
+                size_t minlen = memcmp(hdr->sig,"RCmc",4) == 0 ?
+                    CLUSTERMSG_COMPACT_MIN_LEN : CLUSTERMSG_MIN_LEN;
+                if ((memcmp(hdr->sig,"RCmb",4) != 0 &&
+                     memcmp(hdr->sig,"RCmc",4) != 0) ||
+                    ntohl(hdr->totlen) < minlen)
                 {
                     serverLog(LL_WARNING,
                         "Bad message length or signature received "
@@ -2321,10 +2466,17 @@ void clusterReadHandler(connection *conn) {
             link->rcvbuf = sdscatlen(link->rcvbuf,buf,nread);
             hdr = (clusterMsg*) link->rcvbuf;
             rcvbuflen += nread;
+            server.cluster->stats_bus_bytes_received += nread;
         }
 
         /* Total length obtained? Process this packet. */
         if (rcvbuflen >= 8 && rcvbuflen == ntohl(hdr->totlen)) {
+            if (clusterPreprocessPacket(link) == C_ERR) {
+                serverLog(LL_WARNING,
+                    "Bad compact message received from Cluster bus.");
+                handleLinkIOError(link);
+                return;
+            }
             if (clusterProcessPacket(link)) {
                 sdsfree(link->rcvbuf);
                 link->rcvbuf = sdsempty();
@@ -2345,6 +2497,7 @@ void clusterSendMessage(clusterLink *link, unsigned char *msg, size_t msglen) {
         connSetWriteHandlerWithBarrier(link->conn, clusterWriteHandler, 1);
 
     link->sndbuf = sdscatlen(link->sndbuf, msg, msglen);
+    server.cluster->stats_bus_bytes_sent += msglen;
 
     /* Populate sent messages stats. */
     clusterMsg *hdr = (clusterMsg*) msg;
@@ -2438,6 +2591,8 @@ void clusterBuildMessageHdr(clusterMsg *hdr, int type) {
     /* Set the message flags. */
     if (nodeIsMaster(myself) && server.cluster->mf_end)
         hdr->mflags[0] |= CLUSTERMSG_FLAG0_PAUSED;
+    if (server.cluster_compact_bus)
+        hdr->mflags[0] |= CLUSTERMSG_FLAG0_COMPACT;
 
     /* Compute the message length for certain messages. For other messages
      * this is up to the caller. */
@@ -2479,6 +2634,112 @@ void clusterSetGossipEntry(clusterMsg *hdr, int i, clusterNode *n) {
     gossip->notused1 = 0;
 }
 
+/* Encode the PING/PONG message 'hdr', already populated with its gossip
+ * sections, in the compact format described in cluster.h, with the slots
+ * bitmap encoded against the last one sent on 'link'. The new message is
+ * returned and its length stored in '*lenptr'.
+ *
+ * NULL is returned if the message can't be encoded because some node name
+ * is not a lowercase hex string: in this case the full message is sent. */
+unsigned char *clusterBuildCompactPing(clusterLink *link, clusterMsg *hdr,
+                                       size_t *lenptr)
+{
+    uint16_t count = ntohs(hdr->count);
+    unsigned char *buf, *p;
+    clusterMsgCompact *chdr;
+    int j;
+
+    buf = zcalloc(CLUSTERMSG_COMPACT_MIN_LEN+sizeof(hdr->myslots)+
+                  (CLUSTERMSG_COMPACT_GOSSIP_LEN+NET_IP_STR_LEN)*count);
+    chdr = (clusterMsgCompact*) buf;
+    memcpy(chdr->sig,"RCmc",4);
+    chdr->ver = hdr->ver;
+    chdr->port = hdr->port;
+    chdr->type = hdr->type;
+    chdr->count = hdr->count;
+    chdr->currentEpoch = hdr->currentEpoch;
+    chdr->configEpoch = hdr->configEpoch;
+    chdr->offset = hdr->offset;
+    memcpy(chdr->sender,hdr->sender,CLUSTER_NAMELEN);
+    memcpy(chdr->slaveof,hdr->slaveof,CLUSTER_NAMELEN);
+    memcpy(chdr->myip,hdr->myip,NET_IP_STR_LEN);
+    chdr->cport = hdr->cport;
+    chdr->flags = hdr->flags;
+    chdr->state = hdr->state;
+    memcpy(chdr->mflags,hdr->mflags,sizeof(hdr->mflags));
+    p = chdr->data;
+
+    /* Slots: nothing if unchanged, otherwise the ranges of slots that
+     * changed, or the whole bitmap if the ranges would take more space. */
+    if (memcmp(link->slots_sent,hdr->myslots,sizeof(hdr->myslots)) == 0) {
+        chdr->slotsenc = CLUSTERMSG_SLOTS_SAME;
+    } else {
+        chdr->slotsenc = CLUSTERMSG_SLOTS_DELTA;
+        j = 0;
+        while (j < CLUSTER_SLOTS) {
+            /* Skip unchanged bytes fast. */
+            if ((j&7) == 0 && link->slots_sent[j/8] == hdr->myslots[j/8]) {
+                j += 8;
+                continue;
+            }
+            if (bitmapTestBit(link->slots_sent,j) ==
+                bitmapTestBit(hdr->myslots,j))
+            {
+                j++;
+                continue;
+            }
+            uint16_t start = j, stop;
+            while (j < CLUSTER_SLOTS &&
+                   bitmapTestBit(link->slots_sent,j) !=
+                   bitmapTestBit(hdr->myslots,j)) j++;
+            stop = j-1;
+            if (p-chdr->data+4 >= (long)sizeof(hdr->myslots)) {
+                chdr->slotsenc = CLUSTERMSG_SLOTS_FULL;
+                break;
+            }
+            start = htons(start);
+            stop = htons(stop);
+            memcpy(p,&start,2);
+            memcpy(p+2,&stop,2);
+            p += 4;
+        }
+        if (chdr->slotsenc == CLUSTERMSG_SLOTS_FULL) {
+            p = chdr->data;
+            memcpy(p,hdr->myslots,sizeof(hdr->myslots));
+            p += sizeof(hdr->myslots);
+        }
+    }
+    chdr->slotslen = htons(p-chdr->data);
+
+    /* Gossip sections. */
+    for (j = 0; j < count; j++) {
+        clusterMsgDataGossip *g = &hdr->data.ping.gossip[j];
+        size_t iplen = strnlen(g->ip,NET_IP_STR_LEN-1);
+
+        for (int i = 0; i < CLUSTER_NAMELEN/2; i++) {
+            int hi = clusterHexDigitValue(g->nodename[i*2]);
+            int lo = clusterHexDigitValue(g->nodename[i*2+1]);
+            if (hi == -1 || lo == -1) {
+                zfree(buf);
+                return NULL;
+            }
+            p[i] = (hi<<4)|lo;
+        }
+        memcpy(p+20,&g->ping_sent,4);
+        memcpy(p+24,&g->pong_received,4);
+        memcpy(p+28,&g->port,2);
+        memcpy(p+30,&g->cport,2);
+        memcpy(p+32,&g->flags,2);
+        p[34] = iplen;
+        memcpy(p+CLUSTERMSG_COMPACT_GOSSIP_LEN,g->ip,iplen);
+        p += CLUSTERMSG_COMPACT_GOSSIP_LEN+iplen;
+    }
+
+    *lenptr = p-buf;
+    chdr->totlen = htonl(*lenptr);
+    return buf;
+}
+
 /* Send a PING or PONG packet to the specified node, making sure to add enough
  * gossip information. */
 void clusterSendPing(clusterLink *link, int type) {
@@ -2605,7 +2866,25 @@ void clusterSendPing(clusterLink *link, int type) {
     totlen += (sizeof(clusterMsgDataGossip)*gossipcount);
     hdr->count = htons(gossipcount);
     hdr->totlen = htonl(totlen);
-    clusterSendMessage(link,buf,totlen);
+
+    /* Use the compact format if the receiver supports it. Either way
+     * remember the slots bitmap we sent, since the next compact message
+     * on this link will only carry the difference. */
+    unsigned char *compact = NULL;
+    size_t compactlen = 0;
+    if (server.cluster_compact_bus && link->compact && link->slots_sent)
+        compact = clusterBuildCompactPing(link,hdr,&compactlen);
+    if (link->slots_sent == NULL)
+        link->slots_sent = zmalloc(sizeof(hdr->myslots));
+    memcpy(link->slots_sent,hdr->myslots,sizeof(hdr->myslots));
+
+    if (compact) {
+        clusterSendMessage(link,compact,compactlen);
+        server.cluster->stats_bus_compact_sent++;
+        zfree(compact);
+    } else {
+        clusterSendMessage(link,buf,totlen);
+    }
     zfree(buf);
 }
 
@@ -4312,6 +4591,122 @@ void clusterReplyMultiBulkSlots(client *c) {
     setDeferredArrayLen(c, slot_replylen, num_masters);
 }
 
+#define SLOT_STATS_KEY_COUNT 0
+#define SLOT_STATS_MEMORY 1
+#define SLOT_STATS_DEFAULT_LIMIT 16
+
+static int slot_stats_metric;   /* Metric used by slotStatsCompare(). */
+static int slot_stats_desc;     /* Sort by descending value. */
+
+static unsigned long long slotStatsGet(int slot, int metric) {
+    if (metric == SLOT_STATS_KEY_COUNT) return countKeysInSlot(slot);
+    return getSlotMemoryUsage(slot);
+}
+
+/* qsort() comparator: slots in ascending (or descending) order of
+ * slot_stats_metric, and in ascending order of slot for the same value. */
+static int slotStatsCompare(const void *a, const void *b) {
+    int sa = *(const int*)a, sb = *(const int*)b;
+    unsigned long long va = slotStatsGet(sa,slot_stats_metric),
+                       vb = slotStatsGet(sb,slot_stats_metric);
+
+    if (va != vb) return (va < vb) != slot_stats_desc ? -1 : 1;
+    return sa - sb;
+}
+
+static void addReplySlotStats(client *c, int slot) {
+    addReplyArrayLen(c,2);
+    addReplyLongLong(c,slot);
+    addReplyMapLen(c,2);
+    addReplyBulkCString(c,"key-count");
+    addReplyLongLong(c,countKeysInSlot(slot));
+    addReplyBulkCString(c,"memory-bytes");
+    addReplyLongLong(c,getSlotMemoryUsage(slot));
+}
+
+/* CLUSTER SLOT-STATS: the statistics of the slots served by this node, in
+ * a range or the top slots by a metric. They are tracked as keys are added,
+ * modified and deleted, so no scan of the keyspace is needed: resharding
+ * tools can use it to find the largest slots. */
+void clusterSlotStatsCommand(client *c) {
+    clusterNode *owner = nodeIsSlave(myself) ? myself->slaveof : myself;
+    int *slots, numslots = 0, j;
+
+    slots = zmalloc(sizeof(int)*CLUSTER_SLOTS);
+    if (!strcasecmp(c->argv[2]->ptr,"slotsrange") && c->argc == 5) {
+        int start, end;
+
+        if ((start = getSlotOrReply(c,c->argv[3])) == -1 ||
+            (end = getSlotOrReply(c,c->argv[4])) == -1)
+        {
+            zfree(slots);
+            return;
+        }
+        if (start > end) {
+            addReplyErrorFormat(c,"Start slot number %d is greater than "
+                                  "end slot number %d",start,end);
+            zfree(slots);
+            return;
+        }
+        for (j = start; j <= end; j++)
+            if (owner && server.cluster->slots[j] == owner)
+                slots[numslots++] = j;
+    } else if (!strcasecmp(c->argv[2]->ptr,"orderby")) {
+        long limit = SLOT_STATS_DEFAULT_LIMIT;
+        int desc = 1, metric;
+
+        if (!strcasecmp(c->argv[3]->ptr,"key-count")) {
+            metric = SLOT_STATS_KEY_COUNT;
+        } else if (!strcasecmp(c->argv[3]->ptr,"memory-bytes")) {
+            metric = SLOT_STATS_MEMORY;
+        } else {
+            addReplyErrorFormat(c,"Unrecognized sort metric for ORDERBY. "
+                "The supported metrics are: key-count, memory-bytes");
+            zfree(slots);
+            return;
+        }
+        for (j = 4; j < c->argc; j++) {
+            int moreargs = (c->argc-1) - j;
+            if (!strcasecmp(c->argv[j]->ptr,"limit") && moreargs) {
+                if (getLongFromObjectOrReply(c,c->argv[++j],&limit,NULL)
+                    != C_OK)
+                {
+                    zfree(slots);
+                    return;
+                }
+                if (limit < 1 || limit > CLUSTER_SLOTS) {
+                    addReplyError(c,"Limit has to lie in between 1 and 16384");
+                    zfree(slots);
+                    return;
+                }
+            } else if (!strcasecmp(c->argv[j]->ptr,"asc")) {
+                desc = 0;
+            } else if (!strcasecmp(c->argv[j]->ptr,"desc")) {
+                desc = 1;
+            } else {
+                addReply(c,shared.syntaxerr);
+                zfree(slots);
+                return;
+            }
+        }
+        for (j = 0; j < CLUSTER_SLOTS; j++)
+            if (owner && server.cluster->slots[j] == owner)
+                slots[numslots++] = j;
+        slot_stats_metric = metric;
+        slot_stats_desc = desc;
+        qsort(slots,numslots,sizeof(int),slotStatsCompare);
+        if (numslots > limit) numslots = limit;
+    } else {
+        addReply(c,shared.syntaxerr);
+        zfree(slots);
+        return;
+    }
+
+    addReplyArrayLen(c,numslots);
+    for (j = 0; j < numslots; j++) addReplySlotStats(c,slots[j]);
+    zfree(slots);
+}
+
 void clusterCommand(client *c) {
     if (server.cluster_enabled == 0) {
         addReplyError(c,"This instance has cluster support disabled");
@@ -4341,6 +4736,7 @@ void clusterCommand(client *c) {
 "SETSLOT <slot> (importing|migrating|stable|node <node-id>) -- Set slot state.",
 "REPLICAS <node-id> -- Return <node-id> replicas.",
 "SAVECONFIG - Force saving cluster configuration on disk.",
+"SLOT-STATS (SLOTSRANGE <start> <end> | ORDERBY <key-count|memory-bytes> [LIMIT <n>] [ASC|DESC]) -- Return the number of keys and the approximate memory used by the slots served by the current node.",
 "SLOTS -- Return information about slots range mappings. Each range is made of:",
 "    start, end, master and replicas IP addresses, ports and ids",
 NULL
@@ -4622,6 +5018,15 @@ NULL
         }
         info = sdscatprintf(info,
             "cluster_stats_messages_received:%lld\r\n", tot_msg_received);
+        info = sdscatprintf(info,
+            "cluster_stats_messages_compact_sent:%lld\r\n"
+            "cluster_stats_messages_compact_received:%lld\r\n"
+            "cluster_stats_bytes_sent:%lld\r\n"
+            "cluster_stats_bytes_received:%lld\r\n",
+            server.cluster->stats_bus_compact_sent,
+            server.cluster->stats_bus_compact_received,
+            server.cluster->stats_bus_bytes_sent,
+            server.cluster->stats_bus_bytes_received);
 
         /* Produce the reply protocol. */
         addReplyVerbatim(c,info,sdslen(info),"txt");
@@ -4679,6 +5084,10 @@ NULL
             decrRefCount(keys[j]);
         }
         zfree(keys);
+    } else if (!strcasecmp(c->argv[1]->ptr,"slot-stats") && c->argc >= 4) {
+        /* CLUSTER SLOT-STATS SLOTSRANGE <start> <end> |
+         *                    ORDERBY <metric> [LIMIT <n>] [ASC|DESC] */
+        clusterSlotStatsCommand(c);
     } else if (!strcasecmp(c->argv[1]->ptr,"forget") && c->argc == 3) {
         /* CLUSTER FORGET <NODE ID> */
         clusterNode *n = clusterLookupNode(c->argv[2]->ptr);
@@ -5528,6 +5937,714 @@ socket_err:
     return;
 }
 
+/* -----------------------------------------------------------------------------
+ * ASYNCMIGRATE command
+ *
+ * MIGRATE blocks the server until the target acknowledged the keys, so
+ * moving a large slot means many long stalls. ASYNCMIGRATE instead starts a
+ * migration job driven by the event loop: RESTORE commands for many keys
+ * are pipelined on a non blocking connection, up to a window of
+ * unacknowledged bytes, and a key is deleted locally (and its deletion
+ * propagated) only once the target acknowledged it. A key modified while
+ * its RESTORE is in flight is sent again when acknowledged, or deleted in
+ * the target if it no longer exists here. Only one job runs at a time.
+ * -------------------------------------------------------------------------- */
+
+#define ASYNC_MIGRATE_NONE 0
+#define ASYNC_MIGRATE_CONNECTING 1
+#define ASYNC_MIGRATE_RUNNING 2
+#define ASYNC_MIGRATE_DONE 3
+#define ASYNC_MIGRATE_FAILED 4
+#define ASYNC_MIGRATE_CANCELLED 5
+
+#define ASYNC_MIGRATE_DEFAULT_WINDOW (4*1024*1024) /* Unacknowledged bytes. */
+#define ASYNC_MIGRATE_SCAN_KEYS 128 /* Keys fetched at a time from a slot. */
+
+/* Commands waiting for their reply. */
+#define ASYNC_MIGRATE_CMD_AUTH 0
+#define ASYNC_MIGRATE_CMD_SELECT 1
+#define ASYNC_MIGRATE_CMD_RESTORE 2
+#define ASYNC_MIGRATE_CMD_DEL 3
+
+typedef struct asyncMigratePending {
+    int type;           /* ASYNC_MIGRATE_CMD_* */
+    robj *key;          /* Key of RESTORE and DEL, otherwise NULL. */
+    size_t bytes;       /* Size of the command in the protocol. */
+    int modified;       /* The key was modified after RESTORE was sent. */
+} asyncMigratePending;
+
+typedef struct asyncMigrateJob {
+    int state;              /* ASYNC_MIGRATE_* */
+    connection *conn;
+    sds host;
+    int port;
+    long dbid;              /* Target DB. */
+    redisDb *db;            /* Source DB. */
+    long timeout;           /* Milliseconds without progress before failing. */
+    int replace;
+    sds username, password;
+    size_t window;
+
+    /* Keys to migrate: either the keys of some slots, scanned in order, or
+     * a list of keys. */
+    int *slots;
+    int numslots, slotidx;
+    robj *cursor;           /* Last key scanned in the current slot. */
+    robj **batch;           /* Keys fetched from the current slot. */
+    int batchlen, batchpos;
+    robj **keys;
+    int numkeys, keyidx;
+    list *resend;           /* Modified keys to send again. */
+    long long scan_queued;  /* Keys queued since the slot scan started. */
+    int stalled;            /* Keys left can't be sent yet, see NextKey. */
+    int exhausted;          /* No more keys to send. */
+
+    /* Pipeline. */
+    sds sndbuf;
+    size_t sndpos;
+    sds rcvbuf;
+    list *pending;          /* asyncMigratePending, in the order sent. */
+    dict *inflight;         /* Key -> asyncMigratePending of its RESTORE. */
+    size_t inflight_bytes;
+
+    /* Progress. */
+    mstime_t start_time, end_time, last_io;
+    long long keys_migrated, bytes_sent, bytes_acked;
+    sds error;
+} asyncMigrateJob;
+
+static asyncMigrateJob *asyncMigrate = NULL; /* Running or last job. */
+
+/* Keys are owned by the pending entries. */
+dictType asyncMigrateInflightDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+static char *asyncMigrateStateName(int state) {
+    switch(state) {
+    case ASYNC_MIGRATE_CONNECTING: return "connecting";
+    case ASYNC_MIGRATE_RUNNING: return "running";
+    case ASYNC_MIGRATE_DONE: return "done";
+    case ASYNC_MIGRATE_FAILED: return "failed";
+    case ASYNC_MIGRATE_CANCELLED: return "cancelled";
+    default: return "none";
+    }
+}
+
+static int asyncMigrateInProgress(void) {
+    return asyncMigrate && (asyncMigrate->state == ASYNC_MIGRATE_CONNECTING ||
+                            asyncMigrate->state == ASYNC_MIGRATE_RUNNING);
+}
+
+static void asyncMigrateFreePending(asyncMigratePending *p) {
+    if (p->key) decrRefCount(p->key);
+    zfree(p);
+}
+
+/* Release the connection and the migration state, keeping the progress
+ * for ASYNCMIGRATE STATUS. Keys not acknowledged are left here. */
+static void asyncMigrateStop(asyncMigrateJob *job, int state) {
+    listIter li;
+    listNode *ln;
+    int j;
+
+    job->state = state;
+    job->end_time = mstime();
+    if (job->conn) {
+        connClose(job->conn);
+        job->conn = NULL;
+    }
+    listRewind(job->pending,&li);
+    while((ln = listNext(&li)) != NULL) asyncMigrateFreePending(ln->value);
+    listEmpty(job->pending);
+    dictEmpty(job->inflight,NULL);
+    job->inflight_bytes = 0;
+    listRewind(job->resend,&li);
+    while((ln = listNext(&li)) != NULL) decrRefCount(ln->value);
+    listEmpty(job->resend);
+    for (j = job->batchpos; j < job->batchlen; j++)
+        decrRefCount(job->batch[j]);
+    job->batchlen = job->batchpos = 0;
+    sdsclear(job->sndbuf);
+    job->sndpos = 0;
+    sdsclear(job->rcvbuf);
+    serverLog(state == ASYNC_MIGRATE_DONE ? LL_NOTICE : LL_WARNING,
+        "Asynchronous migration to %s:%d %s: %lld keys migrated%s%s",
+        job->host, job->port, asyncMigrateStateName(state),
+        job->keys_migrated, job->error ? ", " : "",
+        job->error ? job->error : "");
+}
+
+static void asyncMigrateFail(asyncMigrateJob *job, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap,fmt);
+    sdsfree(job->error);
+    job->error = sdscatvprintf(sdsempty(),fmt,ap);
+    va_end(ap);
+    asyncMigrateStop(job,ASYNC_MIGRATE_FAILED);
+}
+
+static void asyncMigrateFreeJob(asyncMigrateJob *job) {
+    int j;
+
+    if (job->state == ASYNC_MIGRATE_CONNECTING ||
+        job->state == ASYNC_MIGRATE_RUNNING)
+        asyncMigrateStop(job,ASYNC_MIGRATE_CANCELLED);
+    for (j = 0; j < job->numkeys; j++) decrRefCount(job->keys[j]);
+    zfree(job->keys);
+    zfree(job->slots);
+    zfree(job->batch);
+    if (job->cursor) decrRefCount(job->cursor);
+    listRelease(job->pending);
+    listRelease(job->resend);
+    dictRelease(job->inflight);
+    sdsfree(job->host);
+    sdsfree(job->username);
+    sdsfree(job->password);
+    sdsfree(job->sndbuf);
+    sdsfree(job->rcvbuf);
+    sdsfree(job->error);
+    zfree(job);
+}
+
+/* Append a command to the send buffer, expecting a reply for it. */
+static void asyncMigrateQueue(asyncMigrateJob *job, int type, robj *key,
+                              size_t bytes)
+{
+    asyncMigratePending *p = zmalloc(sizeof(*p));
+
+    p->type = type;
+    p->key = key;
+    if (key) incrRefCount(key);
+    p->bytes = bytes;
+    p->modified = 0;
+    listAddNodeTail(job->pending,p);
+    if (type == ASYNC_MIGRATE_CMD_RESTORE) {
+        dictAdd(job->inflight,key->ptr,p);
+        job->scan_queued++;
+    }
+    job->inflight_bytes += bytes;
+}
+
+/* Return the next key to send, with a new reference, or NULL if there are
+ * no keys to send now. When all the keys were sent 'exhausted' is set. */
+static robj *asyncMigrateNextKey(asyncMigrateJob *job) {
+    robj *key;
+
+    while (job->keyidx < job->numkeys) {
+        key = job->keys[job->keyidx++];
+        if (dictFind(job->inflight,key->ptr)) continue;
+        incrRefCount(key);
+        return key;
+    }
+
+    while (job->slotidx < job->numslots) {
+        int slot = job->slots[job->slotidx];
+
+        while (job->batchpos < job->batchlen) {
+            key = job->batch[job->batchpos++];
+            if (dictFind(job->inflight,key->ptr)) {
+                decrRefCount(key);
+                continue;
+            }
+            return key;
+        }
+
+        job->batchpos = 0;
+        job->batchlen = getKeysInSlotAfter(slot,
+            job->cursor ? job->cursor->ptr : NULL,
+            job->batch,ASYNC_MIGRATE_SCAN_KEYS);
+        if (job->batchlen) {
+            if (job->cursor) decrRefCount(job->cursor);
+            job->cursor = job->batch[job->batchlen-1];
+            incrRefCount(job->cursor);
+            continue;
+        }
+
+        /* End of the slot. The keys in flight must be acknowledged before
+         * we know if the slot is empty: if keys are left, for instance
+         * because they were added behind the cursor, scan it again. */
+        if (dictSize(job->inflight) || listLength(job->resend)) return NULL;
+        if (job->cursor) {
+            decrRefCount(job->cursor);
+            job->cursor = NULL;
+        }
+        if (countKeysInSlot(slot) == 0) {
+            job->slotidx++;
+        } else if (job->scan_queued == 0) {
+            /* A whole scan queued no key: the keys left can't be sent now,
+             * for instance expired keys that are not deleted because we
+             * turned into a replica. Scanning again would loop forever
+             * without returning to the event loop: retry from
+             * asyncMigrateCron() instead. */
+            job->stalled = 1;
+            return NULL;
+        }
+        job->scan_queued = 0;
+    }
+    job->exhausted = 1;
+    return NULL;
+}
+
+/* Serialize the key and queue its RESTORE command. Keys sent again after
+ * being modified are replaced in the target, or deleted there if they no
+ * longer exist here. */
+static void asyncMigrateSendKey(asyncMigrateJob *job, robj *key, int resend) {
+    size_t oldlen = sdslen(job->sndbuf);
+    long long ttl = 0, expireat;
+    int replace = job->replace || resend;
+    robj *o = NULL;
+    rio cmd, payload;
+
+    if (!expireIfNeeded(job->db,key))
+        o = lookupKey(job->db,key,LOOKUP_NOTOUCH);
+    rioInitWithBuffer(&cmd,job->sndbuf);
+    if (o == NULL) {
+        if (resend) {
+            serverAssert(rioWriteBulkCount(&cmd,'*',2));
+            serverAssert(rioWriteBulkString(&cmd,"DEL",3));
+            serverAssert(rioWriteBulkString(&cmd,key->ptr,sdslen(key->ptr)));
+            job->sndbuf = cmd.io.buffer.ptr;
+            asyncMigrateQueue(job,ASYNC_MIGRATE_CMD_DEL,key,
+                              sdslen(job->sndbuf)-oldlen);
+        }
+        return;
+    }
+
+    expireat = getExpire(job->db,key);
+    if (expireat != -1) {
+        ttl = expireat-mstime();
+        if (ttl < 1) ttl = 1;
+    }
+    serverAssert(rioWriteBulkCount(&cmd,'*',replace ? 5 : 4));
+    if (server.cluster_enabled)
+        serverAssert(rioWriteBulkString(&cmd,"RESTORE-ASKING",14));
+    else
+        serverAssert(rioWriteBulkString(&cmd,"RESTORE",7));
+    serverAssert(rioWriteBulkString(&cmd,key->ptr,sdslen(key->ptr)));
+    serverAssert(rioWriteBulkLongLong(&cmd,ttl));
+    createDumpPayload(&payload,o,key);
+    serverAssert(rioWriteBulkString(&cmd,payload.io.buffer.ptr,
+                                    sdslen(payload.io.buffer.ptr)));
+    sdsfree(payload.io.buffer.ptr);
+    if (replace) serverAssert(rioWriteBulkString(&cmd,"REPLACE",7));
+    job->sndbuf = cmd.io.buffer.ptr;
+    asyncMigrateQueue(job,ASYNC_MIGRATE_CMD_RESTORE,key,
+                      sdslen(job->sndbuf)-oldlen);
+}
+
+static void asyncMigrateWriteHandler(connection *conn) {
+    asyncMigrateJob *job = asyncMigrate;
+
+    while (job->sndpos < sdslen(job->sndbuf)) {
+        int nwritten = connWrite(conn,job->sndbuf+job->sndpos,
+                                 sdslen(job->sndbuf)-job->sndpos);
+        if (nwritten <= 0) {
+            if (nwritten == -1 && connGetState(conn) == CONN_STATE_CONNECTED)
+                return; /* Try again when the socket is writable. */
+            asyncMigrateFail(job,"error writing to target: %s",
+                             connGetLastError(conn));
+            return;
+        }
+        job->sndpos += nwritten;
+        job->bytes_sent += nwritten;
+        job->last_io = mstime();
+    }
+    sdsclear(job->sndbuf);
+    job->sndpos = 0;
+    connSetWriteHandler(conn,NULL);
+}
+
+/* Send keys until the window of unacknowledged bytes is full, and detect
+ * the end of the migration. */
+static void asyncMigrateFill(asyncMigrateJob *job) {
+    job->stalled = 0;
+    while (job->inflight_bytes < job->window) {
+        robj *key;
+        int resend = 0;
+
+        if (listLength(job->resend)) {
+            listNode *ln = listFirst(job->resend);
+            key = ln->value;
+            listDelNode(job->resend,ln);
+            resend = 1;
+        } else if ((key = asyncMigrateNextKey(job)) == NULL) {
+            break;
+        }
+        asyncMigrateSendKey(job,key,resend);
+        decrRefCount(key);
+    }
+
+    if (job->exhausted && listLength(job->pending) == 0 &&
+        listLength(job->resend) == 0)
+    {
+        asyncMigrateStop(job,ASYNC_MIGRATE_DONE);
+        return;
+    }
+    if (job->sndpos < sdslen(job->sndbuf))
+        connSetWriteHandler(job->conn,asyncMigrateWriteHandler);
+}
+
+/* The target acknowledged the key: delete it here, propagating the
+ * deletion like MIGRATE does. */
+static void asyncMigrateDeleteKey(asyncMigrateJob *job, robj *key) {
+    robj *argv[2];
+
+    if (dbDelete(job->db,key)) {
+        signalModifiedKey(NULL,job->db,key);
+        notifyKeyspaceEvent(NOTIFY_GENERIC,"del",key,job->db->id);
+        server.dirty++;
+        argv[0] = shared.del;
+        argv[1] = key;
+        propagate(server.delCommand,job->db->id,argv,2,
+                  PROPAGATE_AOF|PROPAGATE_REPL);
+    }
+}
+
+/* Process the reply of the oldest command in flight. Returns C_ERR if the
+ * job failed. */
+static int asyncMigrateProcessReply(asyncMigrateJob *job, char *reply) {
+    listNode *ln = listFirst(job->pending);
+    asyncMigratePending *p;
+
+    if (ln == NULL) {
+        asyncMigrateFail(job,"unexpected reply from target: %s",reply);
+        return C_ERR;
+    }
+    p = ln->value;
+    listDelNode(job->pending,ln);
+    job->inflight_bytes -= p->bytes;
+    job->bytes_acked += p->bytes;
+    if (p->type == ASYNC_MIGRATE_CMD_RESTORE)
+        dictDelete(job->inflight,p->key->ptr);
+
+    if (reply[0] == '-') {
+        asyncMigrateFail(job,"target replied with error: %s",reply+1);
+        asyncMigrateFreePending(p);
+        return C_ERR;
+    }
+    if (p->type == ASYNC_MIGRATE_CMD_RESTORE) {
+        if (p->modified) {
+            incrRefCount(p->key);
+            listAddNodeTail(job->resend,p->key);
+        } else {
+            asyncMigrateDeleteKey(job,p->key);
+            job->keys_migrated++;
+            server.stat_async_migrate_keys++;
+        }
+    }
+    asyncMigrateFreePending(p);
+    return C_OK;
+}
+
+static void asyncMigrateReadHandler(connection *conn) {
+    asyncMigrateJob *job = asyncMigrate;
+    char buf[PROTO_IOBUF_LEN];
+    char *p, *nl;
+    int nread;
+
+    nread = connRead(conn,buf,sizeof(buf));
+    if (nread <= 0) {
+        if (nread == -1 && connGetState(conn) == CONN_STATE_CONNECTED)
+            return;
+        asyncMigrateFail(job,"error reading from target: %s",
+            nread ? connGetLastError(conn) : "connection closed");
+        return;
+    }
+    job->last_io = mstime();
+    job->rcvbuf = sdscatlen(job->rcvbuf,buf,nread);
+
+    /* All the replies we expect are single line replies. */
+    p = job->rcvbuf;
+    while ((nl = strchr(p,'\n')) != NULL) {
+        *nl = '\0';
+        if (nl > p && nl[-1] == '\r') nl[-1] = '\0';
+        if (asyncMigrateProcessReply(job,p) == C_ERR) return;
+        p = nl+1;
+    }
+    sdsrange(job->rcvbuf,p-job->rcvbuf,-1);
+    asyncMigrateFill(job);
+}
+
+static void asyncMigrateConnectHandler(connection *conn) {
+    asyncMigrateJob *job = asyncMigrate;
+    rio cmd;
+
+    if (connGetState(conn) != CONN_STATE_CONNECTED) {
+        asyncMigrateFail(job,"error connecting to target: %s",
+                         connGetLastError(conn));
+        return;
+    }
+    connEnableTcpNoDelay(conn);
+    connSetReadHandler(conn,asyncMigrateReadHandler);
+    job->state = ASYNC_MIGRATE_RUNNING;
+    job->last_io = mstime();
+
+    if (job->password) {
+        size_t oldlen = sdslen(job->sndbuf);
+        rioInitWithBuffer(&cmd,job->sndbuf);
+        serverAssert(rioWriteBulkCount(&cmd,'*',job->username ? 3 : 2));
+        serverAssert(rioWriteBulkString(&cmd,"AUTH",4));
+        if (job->username)
+            serverAssert(rioWriteBulkString(&cmd,job->username,
+                                            sdslen(job->username)));
+        serverAssert(rioWriteBulkString(&cmd,job->password,
+                                        sdslen(job->password)));
+        job->sndbuf = cmd.io.buffer.ptr;
+        asyncMigrateQueue(job,ASYNC_MIGRATE_CMD_AUTH,NULL,
+                          sdslen(job->sndbuf)-oldlen);
+    }
+    if (job->dbid != 0) {
+        size_t oldlen = sdslen(job->sndbuf);
+        rioInitWithBuffer(&cmd,job->sndbuf);
+        serverAssert(rioWriteBulkCount(&cmd,'*',2));
+        serverAssert(rioWriteBulkString(&cmd,"SELECT",6));
+        serverAssert(rioWriteBulkLongLong(&cmd,job->dbid));
+        job->sndbuf = cmd.io.buffer.ptr;
+        asyncMigrateQueue(job,ASYNC_MIGRATE_CMD_SELECT,NULL,
+                          sdslen(job->sndbuf)-oldlen);
+    }
+    asyncMigrateFill(job);
+}
+
+/* Called by signalModifiedKey(): a key modified while its RESTORE is in
+ * flight must be sent again, since the target may get the old value. */
+void asyncMigrateKeyModified(redisDb *db, robj *key) {
+    asyncMigratePending *p;
+
+    if (!asyncMigrateInProgress() || db != asyncMigrate->db ||
+        !sdsEncodedObject(key)) return;
+    p = dictFetchValue(asyncMigrate->inflight,key->ptr);
+    if (p) p->modified = 1;
+}
+
+/* Called by signalFlushedDb(): every key in flight was modified. */
+void asyncMigrateDbFlushed(int dbid) {
+    dictIterator *di;
+    dictEntry *de;
+
+    if (!asyncMigrateInProgress() ||
+        (dbid != -1 && dbid != asyncMigrate->db->id)) return;
+    di = dictGetIterator(asyncMigrate->inflight);
+    while((de = dictNext(di)) != NULL) {
+        asyncMigratePending *p = dictGetVal(de);
+        p->modified = 1;
+    }
+    dictReleaseIterator(di);
+}
+
+/* Called by serverCron(): fail a job that made no progress for longer than
+ * its timeout, and retry the scan of a stalled job. */
+void asyncMigrateCron(void) {
+    asyncMigrateJob *job = asyncMigrate;
+
+    if (!asyncMigrateInProgress()) return;
+    /* A stalled job with no command in flight is not waiting for the
+     * target, so it can't time out. */
+    if (job->stalled && listLength(job->pending) == 0)
+        job->last_io = mstime();
+    if (mstime()-job->last_io > job->timeout) {
+        asyncMigrateFail(job,"timeout waiting for the target");
+        return;
+    }
+    if (job->stalled) asyncMigrateFill(job);
+}
+
+static void asyncMigrateReplyStatus(client *c) {
+    asyncMigrateJob *job = asyncMigrate;
+    long long remaining = 0;
+    mstime_t elapsed;
+    int j;
+
+    if (job == NULL) {
+        addReplyMapLen(c,1);
+        addReplyBulkCString(c,"state");
+        addReplyBulkCString(c,"none");
+        return;
+    }
+    elapsed = (job->end_time ? job->end_time : mstime()) - job->start_time;
+    if (elapsed < 1) elapsed = 1;
+    for (j = job->slotidx; j < job->numslots; j++)
+        remaining += countKeysInSlot(job->slots[j]);
+    remaining += job->numkeys - job->keyidx + dictSize(job->inflight) +
+                 listLength(job->resend);
+
+    addReplyMapLen(c,12);
+    addReplyBulkCString(c,"state");
+    addReplyBulkCString(c,asyncMigrateStateName(job->state));
+    addReplyBulkCString(c,"target");
+    addReplyBulkSds(c,sdscatprintf(sdsempty(),"%s:%d",job->host,job->port));
+    addReplyBulkCString(c,"keys-migrated");
+    addReplyLongLong(c,job->keys_migrated);
+    addReplyBulkCString(c,"keys-remaining");
+    addReplyLongLong(c,asyncMigrateInProgress() ? remaining : 0);
+    addReplyBulkCString(c,"keys-in-flight");
+    addReplyLongLong(c,dictSize(job->inflight));
+    addReplyBulkCString(c,"bytes-sent");
+    addReplyLongLong(c,job->bytes_sent);
+    addReplyBulkCString(c,"bytes-acked");
+    addReplyLongLong(c,job->bytes_acked);
+    addReplyBulkCString(c,"bytes-in-flight");
+    addReplyLongLong(c,job->inflight_bytes);
+    addReplyBulkCString(c,"elapsed-ms");
+    addReplyLongLong(c,elapsed);
+    addReplyBulkCString(c,"bytes-per-sec");
+    addReplyLongLong(c,job->bytes_acked*1000/elapsed);
+    addReplyBulkCString(c,"keys-per-sec");
+    addReplyLongLong(c,job->keys_migrated*1000/elapsed);
+    addReplyBulkCString(c,"last-error");
+    addReplyBulkCString(c,job->error ? job->error : "");
+}
+
+/* ASYNCMIGRATE START host port dbid timeout [REPLACE] [AUTH password]
+ *         [AUTH2 username password] [WINDOW bytes]
+ *         SLOTS slot [slot ...] | KEYS key [key ...]
+ * ASYNCMIGRATE STATUS
+ * ASYNCMIGRATE CANCEL */
+void asyncMigrateCommand(client *c) {
+    if (c->argc == 2 && !strcasecmp(c->argv[1]->ptr,"help")) {
+        const char *help[] = {
+"START <host> <port> <dbid> <timeout> [REPLACE] [AUTH <password>] [AUTH2 <username> <password>] [WINDOW <bytes>] (SLOTS <slot> [slot ...] | KEYS <key> [key ...]) -- Start migrating the keys of the slots, or the keys, in background. Keys are deleted once the target acknowledged them.",
+"STATUS -- Return the state and the progress of the current or last migration.",
+"CANCEL -- Stop the current migration. Keys not acknowledged yet are kept.",
+NULL
+        };
+        addReplyHelp(c, help);
+    } else if (c->argc == 2 && !strcasecmp(c->argv[1]->ptr,"status")) {
+        asyncMigrateReplyStatus(c);
+    } else if (c->argc == 2 && !strcasecmp(c->argv[1]->ptr,"cancel")) {
+        if (!asyncMigrateInProgress()) {
+            addReplyError(c,"No asynchronous migration in progress");
+            return;
+        }
+        asyncMigrateStop(asyncMigrate,ASYNC_MIGRATE_CANCELLED);
+        addReply(c,shared.ok);
+    } else if (c->argc >= 8 && !strcasecmp(c->argv[1]->ptr,"start")) {
+        long long port, window = ASYNC_MIGRATE_DEFAULT_WINDOW;
+        long dbid, timeout;
+        int replace = 0, j, first = 0, slots = 0;
+        robj *username = NULL, *password = NULL;
+
+        for (j = 6; j < c->argc; j++) {
+            int moreargs = (c->argc-1) - j;
+            if (!strcasecmp(c->argv[j]->ptr,"replace")) {
+                replace = 1;
+            } else if (!strcasecmp(c->argv[j]->ptr,"auth") && moreargs) {
+                password = c->argv[++j];
+            } else if (!strcasecmp(c->argv[j]->ptr,"auth2") && moreargs >= 2) {
+                username = c->argv[++j];
+                password = c->argv[++j];
+            } else if (!strcasecmp(c->argv[j]->ptr,"window") && moreargs) {
+                if (getLongLongFromObjectOrReply(c,c->argv[++j],&window,NULL)
+                    != C_OK) return;
+                if (window <= 0) {
+                    addReplyError(c,"WINDOW must be positive");
+                    return;
+                }
+            } else if ((!strcasecmp(c->argv[j]->ptr,"slots") ||
+                        !strcasecmp(c->argv[j]->ptr,"keys")) && moreargs)
+            {
+                slots = !strcasecmp(c->argv[j]->ptr,"slots");
+                first = j+1;
+                break;
+            } else {
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+        }
+        if (first == 0) {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        if (getLongLongFromObjectOrReply(c,c->argv[3],&port,NULL) != C_OK ||
+            getLongFromObjectOrReply(c,c->argv[4],&dbid,NULL) != C_OK ||
+            getLongFromObjectOrReply(c,c->argv[5],&timeout,NULL) != C_OK)
+            return;
+        if (timeout <= 0) timeout = 1000;
+        if (slots && !server.cluster_enabled) {
+            addReplyError(c,"SLOTS requires cluster support enabled, "
+                            "use KEYS instead");
+            return;
+        }
+        if (server.masterhost) {
+            addReplyError(c,"Can't migrate keys from a replica");
+            return;
+        }
+        if (asyncMigrateInProgress()) {
+            addReplyError(c,"An asynchronous migration is already in progress");
+            return;
+        }
+
+        /* Validate the slots before creating the job. */
+        int *slotv = NULL, numslots = 0;
+        if (slots) {
+            slotv = zmalloc(sizeof(int)*(c->argc-first));
+            for (j = first; j < c->argc; j++) {
+                int slot = getSlotOrReply(c,c->argv[j]);
+                if (slot == -1) {
+                    zfree(slotv);
+                    return;
+                }
+                slotv[numslots++] = slot;
+            }
+        }
+
+        asyncMigrateJob *job = zcalloc(sizeof(*job));
+        if (slots) {
+            job->slots = slotv;
+            job->numslots = numslots;
+            job->batch = zmalloc(sizeof(robj*)*ASYNC_MIGRATE_SCAN_KEYS);
+            job->db = server.db;
+        } else {
+            job->keys = zmalloc(sizeof(robj*)*(c->argc-first));
+            for (j = first; j < c->argc; j++) {
+                job->keys[job->numkeys++] = c->argv[j];
+                incrRefCount(c->argv[j]);
+            }
+            job->db = c->db;
+        }
+        job->host = sdsdup(c->argv[2]->ptr);
+        job->port = port;
+        job->dbid = dbid;
+        job->timeout = timeout;
+        job->replace = replace;
+        if (username) job->username = sdsdup(username->ptr);
+        if (password) job->password = sdsdup(password->ptr);
+        job->window = window;
+        job->resend = listCreate();
+        job->pending = listCreate();
+        job->inflight = dictCreate(&asyncMigrateInflightDictType,NULL);
+        job->sndbuf = sdsempty();
+        job->rcvbuf = sdsempty();
+        job->start_time = job->last_io = mstime();
+        job->state = ASYNC_MIGRATE_CONNECTING;
+
+        if (asyncMigrate) asyncMigrateFreeJob(asyncMigrate);
+        asyncMigrate = job;
+        job->conn = server.tls_cluster ? connCreateTLS() : connCreateSocket();
+        if (connConnect(job->conn,job->host,job->port,NET_FIRST_BIND_ADDR,
+                        asyncMigrateConnectHandler) == C_ERR)
+        {
+            addReplyErrorFormat(c,"Can't connect to target: %s",
+                                connGetLastError(job->conn));
+            asyncMigrateFail(job,"error connecting to target: %s",
+                             connGetLastError(job->conn));
+            return;
+        }
+        serverLog(LL_NOTICE,"Asynchronous migration to %s:%d started",
+                  job->host,job->port);
+        addReply(c,shared.ok);
+    } else {
+        addReplySubcommandSyntaxError(c);
+    }
+}
+
 /* -----------------------------------------------------------------------------
  * Cluster functions related to serving / redirecting clients
  * -------------------------------------------------------------------------- */
@@ -40,6 +40,11 @@ typedef struct clusterLink {
     sds sndbuf;                 /* Packet send buffer */
     sds rcvbuf;                 /* Packet reception buffer */
     struct clusterNode *node;   /* Node related to this link if any, or NULL */
+    int compact;                /* Peer accepts compact PING/PONG messages. */
+    unsigned char *slots_sent;  /* Slots bitmap in the last PING/PONG sent, or
+                                   NULL if none was sent yet. */
+    unsigned char *slots_received; /* Slots bitmap in the last PING/PONG
+                                      received, or NULL. */
 } clusterLink;
 
 /* Cluster node flags and macros. */
@@ -137,6 +142,26 @@ typedef struct clusterNode {
     list *fail_reports;         /* List of nodes signaling this as failing */
 } clusterNode;
 
+/* The keys of every slot are a doubly linked list threaded through the
+ * metadata of the entries of the keyspace dictionary, so finding the keys
+ * of a slot costs no memory nor work besides updating a few pointers. */
+typedef struct clusterDictEntryMetadata {
+    dictEntry *prev;    /* Prev entry with key in the same slot */
+    dictEntry *next;    /* Next entry with key in the same slot */
+    size_t memory;      /* Memory accounted to the slot for this key. */
+} clusterDictEntryMetadata;
+
+typedef struct slotToKeys {
+    uint64_t count;     /* Number of keys in the slot. */
+    size_t memory;      /* Approximate memory used by the keys of the slot. */
+    dictEntry *head;    /* The first key-value entry in the slot. */
+} slotToKeys;
+
+/* Slot to keys mapping for all slots. Only DB 0 has one in cluster mode. */
+struct clusterSlotToKeyMapping {
+    slotToKeys by_slot[CLUSTER_SLOTS];
+};
+
 typedef struct clusterState {
     clusterNode *myself;  /* This node */
     uint64_t currentEpoch;
@@ -147,8 +172,6 @@ typedef struct clusterState {
     clusterNode *migrating_slots_to[CLUSTER_SLOTS];
     clusterNode *importing_slots_from[CLUSTER_SLOTS];
     clusterNode *slots[CLUSTER_SLOTS];
-    uint64_t slots_keys_count[CLUSTER_SLOTS];
-    rax *slots_to_keys;
     /* The following fields are used to take the slave state on elections. */
     mstime_t failover_auth_time; /* Time of previous or next election. */
     int failover_auth_count;    /* Number of votes received so far. */
@@ -175,6 +198,10 @@ typedef struct clusterState {
     long long stats_bus_messages_received[CLUSTERMSG_TYPE_COUNT];
     long long stats_pfail_nodes;    /* Number of nodes in PFAIL status,
                                        excluding nodes without address. */
+    long long stats_bus_bytes_sent;     /* Bytes sent on the cluster bus. */
+    long long stats_bus_bytes_received; /* Bytes received on the cluster bus. */
+    long long stats_bus_compact_sent;   /* Compact PING/PONG messages sent. */
+    long long stats_bus_compact_received; /* Compact PING/PONG received. */
 } clusterState;
 
 /* Redis cluster messages header */
@@ -273,11 +300,65 @@ typedef struct {
 
 #define CLUSTERMSG_MIN_LEN (sizeof(clusterMsg)-sizeof(union clusterMsgData))
 
+/* Compact PING, PONG and MEET messages.
+ *
+ * Nodes setting CLUSTERMSG_FLAG0_COMPACT in their messages are able to
+ * receive PING/PONG messages in this format, that uses the "RCmc" signature
+ * so that the receiver can tell the two formats apart just looking at the
+ * first 8 bytes. The header is the same as clusterMsg without the slots
+ * bitmap, that is sent as a difference against the bitmap of the previous
+ * PING/PONG sent on the same link (TCP guarantees the receiver saw it too).
+ * The first message on every link is always a full one.
+ *
+ * The header is followed by 'slotslen' bytes of slots information, encoded
+ * as specified by 'slotsenc':
+ *
+ * CLUSTERMSG_SLOTS_SAME: no data, the bitmap did not change.
+ * CLUSTERMSG_SLOTS_DELTA: pairs of 16 bit start/end slots (network byte
+ *                         order) of the ranges that changed owner bit.
+ * CLUSTERMSG_SLOTS_FULL: the full bitmap, when shorter than the ranges.
+ *
+ * Then 'count' packed gossip sections follow: the node name as 20 binary
+ * bytes, ping_sent, pong_received (32 bit), port, cport, flags (16 bit),
+ * all in network byte order, and the IP as a length byte plus the address
+ * without null term. The receiver converts the message back to a
+ * clusterMsg before processing it. */
+typedef struct {
+    char sig[4];        /* Signature "RCmc" (Redis Cluster message compact). */
+    uint32_t totlen;    /* Total length of this message */
+    uint16_t ver;       /* Protocol version, currently set to 1. */
+    uint16_t port;      /* TCP base port number. */
+    uint16_t type;      /* Message type */
+    uint16_t count;     /* Number of gossip sections. */
+    uint64_t currentEpoch;  /* The epoch accordingly to the sending node. */
+    uint64_t configEpoch;   /* Same as clusterMsg configEpoch. */
+    uint64_t offset;    /* Same as clusterMsg offset. */
+    char sender[CLUSTER_NAMELEN]; /* Name of the sender node */
+    char slaveof[CLUSTER_NAMELEN];
+    char myip[NET_IP_STR_LEN];    /* Sender IP, if not all zeroed. */
+    uint16_t cport;      /* Sender TCP cluster bus port */
+    uint16_t flags;      /* Sender node flags */
+    unsigned char state; /* Cluster state from the POV of the sender */
+    unsigned char mflags[3]; /* Message flags: CLUSTERMSG_FLAG[012]_... */
+    uint16_t slotslen;   /* Length of the slots information. */
+    unsigned char slotsenc; /* Slots encoding: CLUSTERMSG_SLOTS_... */
+    unsigned char notused1;
+    unsigned char data[8]; /* Slots information and gossip sections. */
+} clusterMsgCompact;
+
+#define CLUSTERMSG_COMPACT_MIN_LEN (offsetof(clusterMsgCompact,data))
+#define CLUSTERMSG_COMPACT_GOSSIP_LEN 35 /* Packed gossip without the IP. */
+
+#define CLUSTERMSG_SLOTS_SAME 0
+#define CLUSTERMSG_SLOTS_DELTA 1
+#define CLUSTERMSG_SLOTS_FULL 2
+
 /* Message flags better specify the packet content or are used to
  * provide some information about the node state. */
 #define CLUSTERMSG_FLAG0_PAUSED (1<<0) /* Master paused for manual failover. */
 #define CLUSTERMSG_FLAG0_FORCEACK (1<<1) /* Give ACK to AUTH_REQUEST even if
                                             master is up. */
+#define CLUSTERMSG_FLAG0_COMPACT (1<<2) /* Sender accepts compact PING/PONG. */
 
 /* ---------------------- API exported outside cluster.c -------------------- */
 clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, int argc, int *hashslot, int *ask);
@@ -178,11 +178,12 @@ robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply) {
  * The program is aborted if the key already exists. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
     sds copy = sdsdup(key->ptr);
-    int retval = dictAdd(db->dict, copy, val);
+    dictEntry *de = dictAddRaw(db->dict, copy, NULL);
 
-    serverAssertWithInfo(NULL,key,retval == DICT_OK);
+    serverAssertWithInfo(NULL,key,de != NULL);
+    dictSetVal(db->dict, de, val);
     signalKeyAsReady(db, key, val->type);
-    if (server.cluster_enabled) slotToKeyAdd(key->ptr);
+    if (server.cluster_enabled) slotToKeyAddEntry(de, db);
 }
 
 /* This is a special version of dbAdd() that is used only when loading
@@ -197,9 +198,10 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  * ownership of the SDS string, otherwise 0 is returned, and is up to the
  * caller to free the SDS string. */
 int dbAddRDBLoad(redisDb *db, sds key, robj *val) {
-    int retval = dictAdd(db->dict, key, val);
-    if (retval != DICT_OK) return 0;
-    if (server.cluster_enabled) slotToKeyAdd(key);
+    dictEntry *de = dictAddRaw(db->dict, key, NULL);
+    if (de == NULL) return 0;
+    dictSetVal(db->dict, de, val);
+    if (server.cluster_enabled) slotToKeyAddEntry(de, db);
     return 1;
 }
 
@@ -218,6 +220,7 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
         val->lru = old->lru;
     }
     dictSetVal(db->dict, de, val);
+    if (server.cluster_enabled) slotToKeyUpdateMemory(db,key);
 
     if (server.lazyfree_lazy_server_del) {
         freeObjAsync(old);
@@ -298,8 +301,10 @@ int dbSyncDelete(redisDb *db, robj *key) {
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
-    if (dictDelete(db->dict,key->ptr) == DICT_OK) {
-        if (server.cluster_enabled) slotToKeyDel(key->ptr);
+    dictEntry *de = dictUnlink(db->dict,key->ptr);
+    if (de) {
+        if (server.cluster_enabled) slotToKeyDelEntry(de,db);
+        dictFreeUnlinkedEntry(db->dict,de);
         return 1;
     } else {
         return 0;
@@ -413,11 +418,8 @@ long long emptyDbGeneric(redisDb *dbarray, int dbnum, int flags, void(callback)(
     /* Post-flush actions */
     if (!backup) {
         if (server.cluster_enabled) {
-            if (async) {
-                slotToKeyFlushAsync();
-            } else {
-                slotToKeyFlush();
-            }
+            for (int j = startdb; j <= enddb; j++)
+                slotToKeyFlush(&dbarray[j]);
         }
         if (dbnum == -1) flushSlaveKeysWithExpireList();
 
@@ -463,13 +465,16 @@ long long dbTotalServerKeyCount() {
 /* Note that the 'c' argument may be NULL if the key was modified out of
  * a context of a client. */
 void signalModifiedKey(client *c, redisDb *db, robj *key) {
+    if (server.cluster_enabled) slotToKeyUpdateMemory(db,key);
     touchWatchedKey(db,key);
     trackingInvalidateKey(c,key);
+    asyncMigrateKeyModified(db,key);
 }
 
 void signalFlushedDb(int dbid) {
     touchWatchedKeysOnFlush(dbid);
     trackingInvalidateKeysOnFlush(dbid);
+    asyncMigrateDbFlushed(dbid);
 }
 
 /*-----------------------------------------------------------------------------
@@ -761,7 +766,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
 
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
@@ -808,17 +813,17 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
     } else if (o->type == OBJ_HASH || o->type == OBJ_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        unsigned char *p = lpFirst(o->ptr);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            vstr = lpGetValue(p,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
@@ -1667,84 +1672,189 @@ int xreadGetKeys(struct redisCommand *cmd, robj **argv, int argc, getKeysResult
 /* Slot to Key API. This is used by Redis Cluster in order to obtain in
  * a fast way a key that belongs to a specified hash slot. This is useful
  * while rehashing the cluster and in other conditions when we need to
- * understand if we have keys for a given hash slot. */
-void slotToKeyUpdateKey(sds key, int add) {
-    size_t keylen = sdslen(key);
-    unsigned int hashslot = keyHashSlot(key,keylen);
-    unsigned char buf[64];
-    unsigned char *indexed = buf;
-
-    server.cluster->slots_keys_count[hashslot] += add ? 1 : -1;
-    if (keylen+2 > 64) indexed = zmalloc(keylen+2);
-    indexed[0] = (hashslot >> 8) & 0xff;
-    indexed[1] = hashslot & 0xff;
-    memcpy(indexed+2,key,keylen);
-    if (add) {
-        raxInsert(server.cluster->slots_to_keys,indexed,keylen+2,NULL,NULL);
+ * understand if we have keys for a given hash slot.
+ *
+ * The keys of a slot are linked together through the metadata of their
+ * dictEntry (see clusterDictEntryMetadata), and every slot also accounts
+ * an approximation of the memory used by its keys, so that the largest
+ * slots can be found without scanning the keyspace. */
+
+/* Returns the size of the metadata of the entries of the keyspace. */
+size_t dbDictEntryMetadataSize(dict *d) {
+    UNUSED(d);
+    return server.cluster_enabled ? sizeof(clusterDictEntryMetadata) : 0;
+}
+
+/* Memory accounted to the slot for the key of the entry: the entry itself,
+ * the key and an estimate of the value. */
+static size_t slotToKeyEntryMemory(redisDb *db, dictEntry *entry) {
+    size_t mem = sizeof(dictEntry) + dictMetadataSize(db->dict) +
+                 sdsZmallocSize(dictGetKey(entry));
+    robj *val = dictGetVal(entry);
+
+    if (val) mem += objectComputeSize(val,OBJ_COMPUTE_SIZE_DEF_SAMPLES);
+    return mem;
+}
+
+/* Adds a key-value entry to the list of keys of its slot. */
+void slotToKeyAddEntry(dictEntry *entry, redisDb *db) {
+    if (db->slots_to_keys == NULL) return;
+    sds key = dictGetKey(entry);
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    slotToKeys *slot_to_keys = &db->slots_to_keys->by_slot[hashslot];
+    clusterDictEntryMetadata *meta = dictMetadata(entry);
+
+    slot_to_keys->count++;
+    meta->memory = slotToKeyEntryMemory(db,entry);
+    slot_to_keys->memory += meta->memory;
+
+    /* Insert the entry at the head of the slot list. */
+    dictEntry *first = slot_to_keys->head;
+    meta->prev = NULL;
+    meta->next = first;
+    if (first != NULL) {
+        clusterDictEntryMetadata *first_meta = dictMetadata(first);
+        first_meta->prev = entry;
+    }
+    slot_to_keys->head = entry;
+}
+
+/* Removes a key-value entry from the list of keys of its slot. */
+void slotToKeyDelEntry(dictEntry *entry, redisDb *db) {
+    if (db->slots_to_keys == NULL) return;
+    sds key = dictGetKey(entry);
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    slotToKeys *slot_to_keys = &db->slots_to_keys->by_slot[hashslot];
+    clusterDictEntryMetadata *meta = dictMetadata(entry);
+
+    slot_to_keys->count--;
+    slot_to_keys->memory -= meta->memory;
+
+    /* Connect previous and next entries to each other. */
+    dictEntry *next = meta->next;
+    dictEntry *prev = meta->prev;
+    if (next != NULL) {
+        clusterDictEntryMetadata *next_meta = dictMetadata(next);
+        next_meta->prev = prev;
+    }
+    if (prev != NULL) {
+        clusterDictEntryMetadata *prev_meta = dictMetadata(prev);
+        prev_meta->next = next;
+    } else {
+        /* The removed entry was the first in the list. */
+        serverAssert(slot_to_keys->head == entry);
+        slot_to_keys->head = next;
+    }
+}
+
+/* Updates the neighbouring entries of an entry that was moved in memory,
+ * for instance by the active defragmentation. */
+void slotToKeyReplaceEntry(dictEntry *entry, redisDb *db) {
+    if (db->slots_to_keys == NULL) return;
+    clusterDictEntryMetadata *meta = dictMetadata(entry);
+
+    if (meta->next != NULL) {
+        clusterDictEntryMetadata *next_meta = dictMetadata(meta->next);
+        next_meta->prev = entry;
+    }
+    if (meta->prev != NULL) {
+        clusterDictEntryMetadata *prev_meta = dictMetadata(meta->prev);
+        prev_meta->next = entry;
     } else {
-        raxRemove(server.cluster->slots_to_keys,indexed,keylen+2,NULL);
+        /* The replaced entry was the first in the list. */
+        sds key = dictGetKey(entry);
+        unsigned int hashslot = keyHashSlot(key,sdslen(key));
+        db->slots_to_keys->by_slot[hashslot].head = entry;
     }
-    if (indexed != buf) zfree(indexed);
 }
 
-void slotToKeyAdd(sds key) {
-    slotToKeyUpdateKey(key,1);
+/* The value of the key was modified: account its new size to the slot. */
+void slotToKeyUpdateMemory(redisDb *db, robj *key) {
+    if (db->slots_to_keys == NULL) return;
+    dictEntry *entry = dictFind(db->dict,key->ptr);
+    if (entry == NULL) return;
+    unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+    slotToKeys *slot_to_keys = &db->slots_to_keys->by_slot[hashslot];
+    clusterDictEntryMetadata *meta = dictMetadata(entry);
+
+    slot_to_keys->memory -= meta->memory;
+    meta->memory = slotToKeyEntryMemory(db,entry);
+    slot_to_keys->memory += meta->memory;
+}
+
+/* Creates the empty slot to keys map of the DB. */
+void slotToKeyInit(redisDb *db) {
+    db->slots_to_keys = zcalloc(sizeof(clusterSlotToKeyMapping));
 }
 
-void slotToKeyDel(sds key) {
-    slotToKeyUpdateKey(key,0);
+/* Empties the slot to keys map. The entries of the keyspace are not
+ * touched: this is called when the keyspace was emptied as well. */
+void slotToKeyFlush(redisDb *db) {
+    if (db->slots_to_keys == NULL) return;
+    memset(db->slots_to_keys,0,sizeof(clusterSlotToKeyMapping));
 }
 
-void slotToKeyFlush(void) {
-    raxFree(server.cluster->slots_to_keys);
-    server.cluster->slots_to_keys = raxNew();
-    memset(server.cluster->slots_keys_count,0,
-           sizeof(server.cluster->slots_keys_count));
+/* Frees the slot to keys map of the DB. */
+void slotToKeyDestroy(redisDb *db) {
+    zfree(db->slots_to_keys);
+    db->slots_to_keys = NULL;
 }
 
 /* Pupulate the specified array of objects with keys in the specified slot.
  * New objects are returned to represent keys, it's up to the caller to
  * decrement the reference count to release the keys names. */
 unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count) {
-    raxIterator iter;
-    int j = 0;
-    unsigned char indexed[2];
-
-    indexed[0] = (hashslot >> 8) & 0xff;
-    indexed[1] = hashslot & 0xff;
-    raxStart(&iter,server.cluster->slots_to_keys);
-    raxSeek(&iter,">=",indexed,2);
-    while(count-- && raxNext(&iter)) {
-        if (iter.key[0] != indexed[0] || iter.key[1] != indexed[1]) break;
-        keys[j++] = createStringObject((char*)iter.key+2,iter.key_len-2);
-    }
-    raxStop(&iter);
+    return getKeysInSlotAfter(hashslot,NULL,keys,count);
+}
+
+/* Like getKeysInSlot() but only returns the keys following 'after' in the
+ * list of keys of the slot, so that a slot can be scanned a few keys at a
+ * time. If 'after' is NULL, or it no longer exists, the keys are returned
+ * from the first one. New keys are added at the head of the list, so they
+ * are only found by scanning the slot again. */
+unsigned int getKeysInSlotAfter(unsigned int hashslot, sds after, robj **keys, unsigned int count) {
+    redisDb *db = server.db;
+    dictEntry *de = db->slots_to_keys->by_slot[hashslot].head;
+    unsigned int j = 0;
+
+    if (after) {
+        dictEntry *cur = dictFind(db->dict,after);
+        if (cur && keyHashSlot(after,sdslen(after)) == hashslot) {
+            clusterDictEntryMetadata *meta = dictMetadata(cur);
+            de = meta->next;
+        }
+    }
+    for (; de != NULL && j < count; j++) {
+        sds key = dictGetKey(de);
+        clusterDictEntryMetadata *meta = dictMetadata(de);
+
+        keys[j] = createStringObject(key,sdslen(key));
+        de = meta->next;
+    }
     return j;
 }
 
 /* Remove all the keys in the specified hash slot.
  * The number of removed items is returned. */
 unsigned int delKeysInSlot(unsigned int hashslot) {
-    raxIterator iter;
-    int j = 0;
-    unsigned char indexed[2];
-
-    indexed[0] = (hashslot >> 8) & 0xff;
-    indexed[1] = hashslot & 0xff;
-    raxStart(&iter,server.cluster->slots_to_keys);
-    while(server.cluster->slots_keys_count[hashslot]) {
-        raxSeek(&iter,">=",indexed,2);
-        raxNext(&iter);
-
-        robj *key = createStringObject((char*)iter.key+2,iter.key_len-2);
+    unsigned int j = 0;
+    dictEntry *de;
+
+    while ((de = server.db->slots_to_keys->by_slot[hashslot].head) != NULL) {
+        sds sdskey = dictGetKey(de);
+        robj *key = createStringObject(sdskey,sdslen(sdskey));
         dbDelete(&server.db[0],key);
         decrRefCount(key);
         j++;
     }
-    raxStop(&iter);
     return j;
 }
 
 unsigned int countKeysInSlot(unsigned int hashslot) {
-    return server.cluster->slots_keys_count[hashslot];
+    return server.db->slots_to_keys->by_slot[hashslot].count;
+}
+
+/* Returns the approximate memory used by the keys of the slot. */
+size_t getSlotMemoryUsage(unsigned int hashslot) {
+    return server.db->slots_to_keys->by_slot[hashslot].memory;
 }
@@ -69,6 +69,7 @@ void* activeDefragAlloc(void *ptr) {
     newptr = zmalloc_no_tcache(size);
     memcpy(newptr, ptr, size);
     zfree_no_tcache(ptr);
+    server.stat_active_defrag_bytes += size;
     return newptr;
 }
 
@@ -728,22 +729,79 @@ typedef struct {
     streamConsumer *c;
 } PendingEntryContext;
 
+/* NACKs live inside the chunks of the consumer group, and are referenced by
+ * the group PEL, the consumers PELs and the delivery time index. A chunk
+ * worth moving is copied to a new allocation, but the old one is released
+ * only after all the references are updated: meanwhile its 'size' is zero
+ * and its 'next' field points to the new copy. Returns the list of the old
+ * chunks, linked by the 'prev' field. */
+streamNACKChunk *defragStreamNACKChunks(streamCG *cg, long *defragged) {
+    streamNACKChunk *chunk = cg->nack_chunks, *moved = NULL;
+    while (chunk) {
+        streamNACKChunk *next = chunk->next, *newchunk;
+        streamNACKSlot **slotref;
+        size_t size;
+        uint32_t j;
+
+        if (!je_get_defrag_hint(chunk)) {
+            server.stat_active_defrag_misses++;
+            chunk = next;
+            continue;
+        }
+        size = zmalloc_size(chunk);
+        newchunk = zmalloc_no_tcache(size);
+        memcpy(newchunk, chunk, size);
+        server.stat_active_defrag_bytes += size;
+        (*defragged)++;
+
+        /* Fix the list links and the pointers inside the chunk. */
+        if (newchunk->prev) newchunk->prev->next = newchunk;
+        else cg->nack_chunks = newchunk;
+        if (newchunk->next) newchunk->next->prev = newchunk;
+        else cg->nack_chunks_tail = newchunk;
+        for (j = 0; j < newchunk->size; j++)
+            newchunk->slots[j].chunk = newchunk;
+        slotref = &newchunk->free;
+        while (*slotref) {
+            *slotref = (streamNACKSlot*)
+                ((char*)newchunk + ((char*)*slotref - (char*)chunk));
+            slotref = &(*slotref)->u.next;
+        }
+
+        chunk->size = 0;
+        chunk->next = newchunk;
+        chunk->prev = moved;
+        moved = chunk;
+        chunk = next;
+    }
+    return moved;
+}
+
+/* Return the new address of a NACK if its chunk was moved by
+ * defragStreamNACKChunks(), otherwise NULL. */
+streamNACK *defragStreamMovedNACK(streamNACK *nack) {
+    streamNACKSlot *slot = (streamNACKSlot*)nack;
+    streamNACKChunk *chunk = slot->chunk;
+    if (chunk->size != 0) return NULL;
+    return &chunk->next->slots[slot - chunk->slots].u.nack;
+}
+
 void* defragStreamConsumerPendingEntry(raxIterator *ri, void *privdata, long *defragged) {
     UNUSED(defragged);
     PendingEntryContext *ctx = privdata;
     streamNACK *nack = ri->data, *newnack;
+    if ((newnack = defragStreamMovedNACK(nack)))
+        nack = newnack;
     nack->consumer = ctx->c; /* update nack pointer to consumer */
-    newnack = activeDefragAlloc(nack);
-    if (newnack) {
-        /* update consumer group pointer to the nack */
-        void *prev;
-        raxInsert(ctx->cg->pel, ri->key, ri->key_len, newnack, &prev);
-        serverAssert(prev==nack);
-        /* note: we don't increment 'defragged' that's done by the caller */
-    }
     return newnack;
 }
 
+void* defragStreamPendingEntry(raxIterator *ri, void *privdata, long *defragged) {
+    UNUSED(privdata);
+    UNUSED(defragged);
+    return defragStreamMovedNACK(ri->data);
+}
+
 void* defragStreamConsumer(raxIterator *ri, void *privdata, long *defragged) {
     streamConsumer *c = ri->data;
     streamCG *cg = privdata;
@@ -764,11 +822,21 @@ void* defragStreamConsumer(raxIterator *ri, void *privdata, long *defragged) {
 
 void* defragStreamConsumerGroup(raxIterator *ri, void *privdata, long *defragged) {
     streamCG *cg = ri->data;
+    streamNACKChunk *moved;
     UNUSED(privdata);
+    moved = defragStreamNACKChunks(cg, defragged);
     if (cg->consumers)
         *defragged += defragRadixTree(&cg->consumers, 0, defragStreamConsumer, cg);
     if (cg->pel)
-        *defragged += defragRadixTree(&cg->pel, 0, NULL, NULL);
+        *defragged += defragRadixTree(&cg->pel, 0, defragStreamPendingEntry, NULL);
+    if (cg->pel_by_time)
+        *defragged += defragRadixTree(&cg->pel_by_time, 0, defragStreamPendingEntry, NULL);
+    /* All the references to the moved NACKs were updated. */
+    while (moved) {
+        streamNACKChunk *prev = moved->prev;
+        zfree_no_tcache(moved);
+        moved = prev;
+    }
     return NULL;
 }
 
@@ -846,7 +914,7 @@ long defragKey(redisDb *db, dictEntry *de) {
             serverPanic("Unknown set encoding");
         }
     } else if (ob->type == OBJ_ZSET) {
-        if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (ob->encoding == OBJ_ENCODING_LISTPACK) {
             if ((newzl = activeDefragAlloc(ob->ptr)))
                 defragged++, ob->ptr = newzl;
         } else if (ob->encoding == OBJ_ENCODING_SKIPLIST) {
@@ -855,7 +923,7 @@ long defragKey(redisDb *db, dictEntry *de) {
             serverPanic("Unknown sorted set encoding");
         }
     } else if (ob->type == OBJ_HASH) {
-        if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (ob->encoding == OBJ_ENCODING_LISTPACK) {
             if ((newzl = activeDefragAlloc(ob->ptr)))
                 defragged++, ob->ptr = newzl;
         } else if (ob->encoding == OBJ_ENCODING_HT) {
@@ -898,6 +966,21 @@ void defragDictBucketCallback(void *privdata, dictEntry **bucketref) {
     }
 }
 
+/* Like defragDictBucketCallback() for the keyspace of the DB 'privdata':
+ * the keys of a slot are linked together, so the neighbours of a moved
+ * entry are updated as well. */
+void defragKeyspaceBucketCallback(void *privdata, dictEntry **bucketref) {
+    redisDb *db = privdata;
+    while(*bucketref) {
+        dictEntry *de = *bucketref, *newde;
+        if ((newde = activeDefragAlloc(de))) {
+            *bucketref = newde;
+            if (server.cluster_enabled) slotToKeyReplaceEntry(newde, db);
+        }
+        bucketref = &(*bucketref)->next;
+    }
+}
+
 /* Utility function to get the fragmentation ratio from jemalloc.
  * It is critical to do that by comparing only heap maps that belong to
  * jemalloc, and skip ones the jemalloc keeps as spare. Since we use this
@@ -1057,6 +1140,294 @@ void computeDefragCycles() {
     }
 }
 
+/* -----------------------------------------------------------------------------
+ * Threaded defrag scan (active-defrag-threaded yes)
+ *
+ * Walking the keyspace and asking jemalloc which allocations are worth moving
+ * is the bulk of the defrag work, while only a small fraction of the keys
+ * usually end up being moved. In threaded mode a helper thread performs the
+ * scan and the je_get_defrag_hint() checks, producing a list of candidate keys,
+ * and the main thread cron only relocates the allocations of these keys.
+ *
+ * The helper thread accesses the keyspace only while holding the module GIL,
+ * which the main thread releases while it sleeps in the event loop (see
+ * beforeSleep()), so the candidates list and the scan state below are
+ * protected by the GIL as well.
+ * -------------------------------------------------------------------------- */
+
+#define DEFRAG_SCAN_SLICE_US 1000       /* Max time the scan thread holds the GIL. */
+#define DEFRAG_SCAN_MAX_CANDIDATES 4096 /* Stop scanning when the main thread is behind. */
+
+typedef struct defragCandidate {
+    int dbid;
+    sds key;
+} defragCandidate;
+
+static list *defrag_candidates = NULL;  /* List of defragCandidate. */
+static int defrag_scan_active = 0;      /* A scan pass was requested by the main thread. */
+static int defrag_scan_done = 0;        /* The scan thread completed the pass. */
+static int defrag_scan_db = 0;          /* DB the scan thread is scanning. */
+static unsigned long defrag_scan_cursor = 0;
+static int defrag_scan_thread_started = 0;
+
+void freeDefragCandidate(void *ptr) {
+    defragCandidate *dc = ptr;
+    sdsfree(dc->key);
+    zfree(dc);
+}
+
+/* Returns 1 if the allocations of the dict (and its entries, if the dict is
+ * small enough to be handled in the main dict scan) look worth moving. */
+int defragHintDict(dict *d, int val_is_sds) {
+    dictIterator *di;
+    dictEntry *de;
+    int hint = 0;
+
+    if (je_get_defrag_hint(d) ||
+        (d->ht[0].table && je_get_defrag_hint(d->ht[0].table)) ||
+        (d->ht[1].table && je_get_defrag_hint(d->ht[1].table)))
+        return 1;
+    /* Big values are handled by defragLater() anyway. */
+    if (dictSize(d) > server.active_defrag_max_scan_fields)
+        return 1;
+    di = dictGetIterator(d);
+    while(!hint && (de = dictNext(di)) != NULL) {
+        hint = je_get_defrag_hint(de) ||
+               je_get_defrag_hint(sdsAllocPtr(dictGetKey(de))) ||
+               (val_is_sds && dictGetVal(de) &&
+                je_get_defrag_hint(sdsAllocPtr(dictGetVal(de))));
+    }
+    dictReleaseIterator(di);
+    return hint;
+}
+
+/* Returns 1 if any of the allocations defragKey() would try to move for this
+ * key look worth moving. Called by the scan thread with the GIL held. */
+int defragHintKey(const dictEntry *de) {
+    robj *ob = dictGetVal(de);
+
+    if (je_get_defrag_hint((void*)de) ||
+        je_get_defrag_hint(sdsAllocPtr(dictGetKey(de))))
+        return 1;
+    /* Shared objects are never moved, see activeDefragStringOb(). */
+    if (ob->refcount != 1) return 0;
+    if (je_get_defrag_hint(ob)) return 1;
+
+    if (ob->type == OBJ_STRING) {
+        return ob->encoding == OBJ_ENCODING_RAW &&
+               je_get_defrag_hint(sdsAllocPtr(ob->ptr));
+    } else if (ob->type == OBJ_LIST) {
+        if (ob->encoding == OBJ_ENCODING_QUICKLIST) {
+            quicklist *ql = ob->ptr;
+            quicklistNode *node;
+            if (je_get_defrag_hint(ql) || ql->len > server.active_defrag_max_scan_fields)
+                return 1;
+            for (node = ql->head; node; node = node->next) {
+                if (je_get_defrag_hint(node) || je_get_defrag_hint(node->zl))
+                    return 1;
+            }
+            return 0;
+        }
+        return je_get_defrag_hint(ob->ptr);
+    } else if (ob->type == OBJ_SET) {
+        if (ob->encoding == OBJ_ENCODING_HT)
+            return defragHintDict(ob->ptr, 0);
+        return je_get_defrag_hint(ob->ptr);
+    } else if (ob->type == OBJ_ZSET) {
+        if (ob->encoding == OBJ_ENCODING_SKIPLIST) {
+            zset *zs = ob->ptr;
+            zskiplistNode *x;
+            if (je_get_defrag_hint(zs) || je_get_defrag_hint(zs->zsl) ||
+                je_get_defrag_hint(zs->zsl->header) || defragHintDict(zs->dict, 0))
+                return 1;
+            for (x = zs->zsl->header->level[0].forward; x; x = x->level[0].forward) {
+                if (je_get_defrag_hint(x)) return 1;
+            }
+            return 0;
+        }
+        return je_get_defrag_hint(ob->ptr);
+    } else if (ob->type == OBJ_HASH) {
+        if (ob->encoding == OBJ_ENCODING_HT)
+            return defragHintDict(ob->ptr, 1);
+        return je_get_defrag_hint(ob->ptr);
+    } else if (ob->type == OBJ_STREAM) {
+        /* Walking the radix trees is as expensive as defragging them. */
+        return 1;
+    }
+    return 0;
+}
+
+/* Scan callback of the scan thread: queue the keys worth defragging. */
+void defragHintScanCallback(void *privdata, const dictEntry *de) {
+    redisDb *db = privdata;
+    server.stat_active_defrag_scanned++;
+    if (defragHintKey(de)) {
+        defragCandidate *dc = zmalloc(sizeof(*dc));
+        dc->dbid = db->id;
+        dc->key = sdsdup(dictGetKey(de));
+        listAddNodeTail(defrag_candidates, dc);
+        server.stat_active_defrag_candidates++;
+    } else {
+        server.stat_active_defrag_key_misses++;
+    }
+}
+
+/* Performs a slice of the scan pass. Must be called with the GIL held.
+ * Returns 1 if there is nothing to do and the thread can sleep longer. */
+int defragScanStep(void) {
+    long long endtime;
+    unsigned int iterations = 0;
+
+    if (!defrag_scan_active || defrag_scan_done || hasActiveChildProcess())
+        return 1;
+    endtime = ustime() + DEFRAG_SCAN_SLICE_US;
+    while (listLength(defrag_candidates) < DEFRAG_SCAN_MAX_CANDIDATES) {
+        redisDb *db = &server.db[defrag_scan_db];
+        defrag_scan_cursor = dictScan(db->dict, defrag_scan_cursor,
+                                      defragHintScanCallback, NULL, db);
+        if (!defrag_scan_cursor && ++defrag_scan_db >= server.dbnum) {
+            defrag_scan_done = 1;
+            break;
+        }
+        if (++iterations > 16) {
+            if (ustime() > endtime) break;
+            iterations = 0;
+        }
+    }
+    return 0;
+}
+
+void *defragScanThreadMain(void *arg) {
+    UNUSED(arg);
+    redis_set_thread_title("defrag_scan");
+    makeThreadKillable();
+    while(1) {
+        int idle;
+        moduleAcquireGIL();
+        idle = defragScanStep();
+        moduleReleaseGIL();
+        /* Give the main thread a chance to grab the GIL between slices. */
+        usleep(idle ? 100000 : DEFRAG_SCAN_SLICE_US);
+    }
+    return NULL;
+}
+
+/* Defrag a key found by the scan thread, including its main dictEntry (which
+ * is otherwise handled by defragDictBucketCallback). */
+void defragCandidateKey(defragCandidate *dc) {
+    redisDb *db = &server.db[dc->dbid];
+    dictEntry *de, **deref, *newde;
+
+    /* The key may have been deleted since the scan thread picked it. */
+    if ((de = dictFind(db->dict, dc->key)) == NULL) return;
+    deref = dictFindEntryRefByPtrAndHash(db->dict, dictGetKey(de),
+                                         dictGetHash(db->dict, dc->key));
+    long defragged = 0;
+    if (deref && (newde = activeDefragAlloc(*deref))) {
+        *deref = de = newde;
+        if (server.cluster_enabled) slotToKeyReplaceEntry(newde, db);
+        defragged++;
+    }
+    /* The scan thread already counted the key as scanned. */
+    defragged += defragKey(db, de);
+    server.stat_active_defrag_hits += defragged;
+    if (defragged)
+        server.stat_active_defrag_key_hits++;
+    else
+        server.stat_active_defrag_key_misses++;
+}
+
+/* Process the defrag_later lists of all the databases. Keys are only queued
+ * for later while all the lists are empty, so the key defragLaterStep() is in
+ * the middle of is always at the head of the first non empty list.
+ * Returns 1 if time is up and more work is needed. */
+int defragLaterStepAllDbs(long long endtime) {
+    int j;
+    for (j = 0; j < server.dbnum; j++) {
+        if (defragLaterStep(&server.db[j], endtime))
+            return 1;
+    }
+    return 0;
+}
+
+/* Forget the state of the current threaded scan pass. */
+void resetDefragScan(void) {
+    if (defrag_candidates) listEmpty(defrag_candidates);
+    defrag_scan_active = 0;
+    defrag_scan_done = 0;
+    defrag_scan_db = 0;
+    defrag_scan_cursor = 0;
+}
+
+/* Abort the current threaded scan pass, including the big keys queued for
+ * later by the candidates processed so far. */
+void stopDefragScan(void) {
+    int j;
+    for (j = 0; j < server.dbnum; j++)
+        listEmpty(server.db[j].defrag_later);
+    defrag_later_current_key = NULL;
+    defrag_later_cursor = 0;
+    resetDefragScan();
+}
+
+/* Main thread side of the threaded defrag, called by activeDefragCycle():
+ * start a scan pass if needed and move the allocations of the candidates
+ * produced so far, until endtime. */
+void activeDefragThreadedCycle(long long endtime) {
+    static long long start_scan, start_stat;
+    unsigned int iterations = 0;
+    listNode *ln;
+
+    if (!defrag_scan_thread_started) {
+        pthread_t thread;
+        defrag_candidates = listCreate();
+        listSetFreeMethod(defrag_candidates, freeDefragCandidate);
+        if (pthread_create(&thread, NULL, defragScanThreadMain, NULL) != 0) {
+            serverLog(LL_WARNING, "Fatal: Can't initialize the defrag scan thread.");
+            exit(1);
+        }
+        defrag_scan_thread_started = 1;
+    }
+
+    if (!defrag_scan_active) {
+        resetDefragScan();
+        defrag_scan_active = 1;
+        start_scan = ustime();
+        start_stat = server.stat_active_defrag_hits;
+    }
+
+    if (defragLaterStepAllDbs(endtime)) return;
+    while ((ln = listFirst(defrag_candidates)) != NULL) {
+        defragCandidateKey(listNodeValue(ln));
+        listDelNode(defrag_candidates, ln);
+        if (defragLaterStepAllDbs(endtime)) return;
+        if (++iterations > 16) {
+            if (ustime() > endtime) return;
+            iterations = 0;
+        }
+    }
+
+    if (defrag_scan_done) {
+        long long now = ustime();
+        size_t frag_bytes;
+        float frag_pct;
+
+        defragOtherGlobals();
+        frag_pct = getAllocatorFragmentation(&frag_bytes);
+        serverLog(LL_VERBOSE,
+            "Active defrag (threaded) done in %dms, reallocated=%d, frag=%.0f%%, frag_bytes=%zu",
+            (int)((now - start_scan)/1000), (int)(server.stat_active_defrag_hits - start_stat), frag_pct, frag_bytes);
+        resetDefragScan();
+        server.active_defrag_running = 0;
+        computeDefragCycles(); /* if another scan is needed, start it on the next cycle */
+    }
+}
+
+/* Number of keys the scan thread queued and the main thread didn't process yet. */
+unsigned long activeDefragPendingCandidates(void) {
+    return defrag_candidates ? listLength(defrag_candidates) : 0;
+}
+
 /* Perform incremental defragmentation work from the serverCron.
  * This works in a similar way to activeExpireCycle, in the sense that
  * we do incremental work across calls. */
@@ -1084,9 +1455,17 @@ void activeDefragCycle(void) {
             cursor = 0;
             db = NULL;
         }
+        if (defrag_scan_active) stopDefragScan();
         return;
     }
 
+    /* If active-defrag-threaded was turned off mid-run, drop the candidates
+     * and let the regular scan start from fresh. */
+    if (!server.active_defrag_threaded && defrag_scan_active) {
+        stopDefragScan();
+        server.active_defrag_running = 0;
+    }
+
     if (hasActiveChildProcess())
         return; /* Defragging memory while there's a fork will just do damage. */
 
@@ -1105,6 +1484,15 @@ void activeDefragCycle(void) {
     endtime = start + timelimit;
     latencyStartMonitor(latency);
 
+    /* While loading the main thread never releases the GIL, so the scan
+     * thread can't make progress. */
+    if (server.active_defrag_threaded && !server.loading) {
+        activeDefragThreadedCycle(endtime);
+        latencyEndMonitor(latency);
+        latencyAddSampleIfNeeded("active-defrag-cycle",latency);
+        return;
+    }
+
     do {
         /* if we're not continuing a scan from the last call or loop, start a new one */
         if (!cursor) {
@@ -1154,7 +1542,7 @@ void activeDefragCycle(void) {
                 break; /* this will exit the function and we'll continue on the next cycle */
             }
 
-            cursor = dictScan(db->dict, cursor, defragScanCallback, defragDictBucketCallback, db);
+            cursor = dictScan(db->dict, cursor, defragScanCallback, defragKeyspaceBucketCallback, db);
 
             /* Once in 16 scan iterations, 512 pointer reallocations. or 64 keys
              * (if we have a lot of pointers in one hash bucket or rehasing),
@@ -1185,4 +1573,8 @@ void activeDefragCycle(void) {
     /* Not implemented yet. */
 }
 
+unsigned long activeDefragPendingCandidates(void) {
+    return 0;
+}
+
 #endif
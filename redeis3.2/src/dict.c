@@ -176,7 +176,7 @@ int dictResize(dict *d)
     // 重置最少需要的空间
     minimal = d->ht[0].used; 
     if (minimal < DICT_HT_INITIAL_SIZE)
-        minimal = DICT_HT_INITIAL_SIZE
+        minimal = DICT_HT_INITIAL_SIZE;
     //调整字典的大小
     return dictExpand(d, minimal);
 }
@@ -474,7 +474,11 @@ dictEntry *dictAddRaw(dict *d, void *key, dictEntry **existing)
     ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0]; 
     
     // 分配空间
-    entry = zmalloc(sizeof(*entry)); 
+    size_t metasize = dictMetadataSize(d);
+    entry = zmalloc(sizeof(*entry) + metasize);
+    if (metasize > 0) {
+        memset(dictMetadata(entry), 0, metasize);
+    }
 
     // 将新节点插入到链表头
     entry->next = ht->table[index]; 
@@ -57,8 +57,13 @@ typedef struct dictEntry
         double d;
     } v;
     struct dictEntry *next; // 指向下个哈希表节点，形成链表，哈希冲突时使用(链地址法)
+    void *metadata[];       /* An arbitrary number of bytes (starting at a
+                             * pointer-aligned address) of size as returned
+                             * by dictType's dictEntryMetadataBytes(). */
 } dictEntry;
 
+struct dict;
+
 // 字典类型特定函数
 typedef struct dictType
 {
@@ -68,6 +73,9 @@ typedef struct dictType
     int (*keyCompare)(void *privdata, const void *key1, const void *key2); // 键比较函数，形式是 函数指针
     void (*keyDestructor)(void *privdata, void *key);                      // 键销毁函数，形式是 函数指针
     void (*valDestructor)(void *privdata, void *obj);                      // 值销毁函数，形式是 函数指针
+    /* Allow a dictEntry to carry extra caller-defined metadata. The
+     * extra memory is initialized to 0 when a dictEntry is allocated. */
+    size_t (*dictEntryMetadataBytes)(struct dict *d);
 } dictType;
 
 /* This is our hash table structure. Every dictionary has two of this as we
@@ -197,6 +205,11 @@ typedef void(dictScanBucketFunction)(void *privdata, dictEntry **bucketref);
 #define dictGetUnsignedIntegerVal(he) ((he)->v.u64)
 // 返回给定节点的double类型值
 #define dictGetDoubleVal(he) ((he)->v.d)
+// 返回给定节点的元数据
+#define dictMetadata(entry) ((void *)(entry)->metadata)
+// 返回字典节点元数据的大小
+#define dictMetadataSize(d) ((d)->type->dictEntryMetadataBytes \
+                             ? (d)->type->dictEntryMetadataBytes(d) : 0)
 // 返回给定字典的大小
 #define dictSlots(d) ((d)->ht[0].size + (d)->ht[1].size)
 // 返回字典的已有节点数量
@@ -326,8 +326,8 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
     size_t origincount = ga->used;
     sds member;
 
-    // 在 ziplist 编码的有序集合中进行查找
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    // 在 listpack 编码的有序集合中进行查找
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr = NULL;
@@ -342,7 +342,7 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
         }
 
          // 指向分值处于范围之内的第一个元素
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         while (eptr) {
 
             // 取出分值
@@ -353,8 +353,8 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
             if (!zslValueLteMax(score, &range))
                 break;
 
-            /* We know the element exists. ziplistGet should always succeed */
-            ziplistGet(eptr, &vstr, &vlen, &vlong);
+            /* We know the element exists. lpGetValue always succeeds */
+            vstr = lpGetValue(eptr, &vlen, &vlong);
             member = (vstr == NULL) ? sdsfromlonglong(vlong) :
                                       sdsnewlen(vstr,vlen);
 
@@ -824,7 +824,7 @@ void georadiusGeneric(client *c, int flags) {
         }
 
         if (returned_items) {
-            zsetConvertToZiplistIfNeeded(zobj,maxelelen);
+            zsetConvertToListpackIfNeeded(zobj,maxelelen);
             setKey(c,c->db,storekey,zobj);
             decrRefCount(zobj);
             notifyKeyspaceEvent(NOTIFY_ZSET,"georadiusstore",storekey,
@@ -1179,7 +1179,7 @@ struct commandHelp {
     14,
     "5.0.0" },
     { "XPENDING",
-    "key group [start end count] [consumer]",
+    "key group [[IDLE min-idle-time] start end count [consumer]]",
     "Return information and entries from a stream consumer group pending entries list, that are messages fetched but never acknowledged.",
     14,
     "5.0.0" },
@@ -35,6 +35,14 @@
 #include "zmalloc.h"
 #include "endianconv.h"
 
+/* The final step of the search is performed with SSE2 compares when the
+ * target supports them: the integers are stored little endian, so this is
+ * only possible on little endian hosts. */
+#if defined(__SSE2__) && (BYTE_ORDER == LITTLE_ENDIAN)
+#include <emmintrin.h>
+#define INTSET_USE_SSE2 1
+#endif
+
 /* Note that these encodings are ordered, so:
  * INTSET_ENC_INT16 < INTSET_ENC_INT32 < INTSET_ENC_INT64. */
 #define INTSET_ENC_INT16 (sizeof(int16_t))
@@ -108,23 +116,86 @@ static intset *intsetResize(intset *is, uint32_t len) {
     return is;
 }
 
+/* Number of elements scanned linearly (or with a single pair of vector
+ * compares) at the end of a search, once the binary search narrowed the
+ * range enough: 32 bytes worth of elements. */
+#define INTSET_SCAN_BYTES 32
+
+/* Return the position of the first element >= "value" in the range
+ * [lo,hi) of the intset, or 'hi' if there is none.
+ *
+ * The caller must guarantee that all the elements at positions >= hi are
+ * greater or equal to "value" (this is trivially true when hi is the length
+ * of the set): this way the final scan can safely look at a full window of
+ * elements past 'hi' without changing the result. */
+static uint32_t intsetLowerBound(intset *is, uint32_t lo, uint32_t hi,
+                                 int64_t value)
+{
+    uint8_t enc = intrev32ifbe(is->encoding);
+    uint32_t len = intrev32ifbe(is->length);
+    uint32_t window = INTSET_SCAN_BYTES/enc;
+
+    /* Values not representable with the set encoding are either smaller or
+     * greater than every element. */
+    if (_intsetValueEncoding(value) > enc) return value < 0 ? lo : hi;
+
+    /* Binary search without an early exit on equality: we always want the
+     * first element >= value, and the loop is more predictable this way. */
+    while (hi-lo > window) {
+        uint32_t mid = lo+(hi-lo)/2;
+        if (_intsetGetEncoded(is,mid,enc) < value)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+
+#ifdef INTSET_USE_SSE2
+    /* Count the elements smaller than "value" in the window starting at
+     * 'lo': since the set is sorted and everything from 'hi' on is not
+     * smaller than "value", the count is the offset of the lower bound. */
+    if (lo+window <= len && enc != INTSET_ENC_INT64) {
+        const __m128i *p =
+            (const __m128i*)(is->contents+(size_t)lo*enc);
+        __m128i a = _mm_loadu_si128(p);
+        __m128i b = _mm_loadu_si128(p+1);
+        unsigned int mask;
+
+        if (enc == INTSET_ENC_INT16) {
+            __m128i v = _mm_set1_epi16((int16_t)value);
+            mask = _mm_movemask_epi8(_mm_cmplt_epi16(a,v)) |
+                   (_mm_movemask_epi8(_mm_cmplt_epi16(b,v)) << 16);
+        } else {
+            __m128i v = _mm_set1_epi32((int32_t)value);
+            mask = _mm_movemask_epi8(_mm_cmplt_epi32(a,v)) |
+                   (_mm_movemask_epi8(_mm_cmplt_epi32(b,v)) << 16);
+        }
+        /* Every matching element sets 'enc' bits of the byte mask. */
+        return lo + __builtin_popcount(mask)/enc;
+    }
+#else
+    (void)len;
+#endif
+    while (lo < hi && _intsetGetEncoded(is,lo,enc) < value) lo++;
+    return lo;
+}
+
 /* Search for the position of "value". Return 1 when the value was found and
  * sets "pos" to the position of the value within the intset. Return 0 when
  * the value is not present in the intset and sets "pos" to the position
  * where "value" can be inserted. */
 static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
-    int min = 0, max = intrev32ifbe(is->length)-1, mid = -1;
-    int64_t cur = -1;
+    uint32_t len = intrev32ifbe(is->length);
+    uint32_t idx;
 
     /* The value can never be found when the set is empty */
-    if (intrev32ifbe(is->length) == 0) {
+    if (len == 0) {
         if (pos) *pos = 0;
         return 0;
     } else {
         /* Check for the case where we know we cannot find the value,
          * but do know the insert position. */
-        if (value > _intsetGet(is,max)) {
-            if (pos) *pos = intrev32ifbe(is->length);
+        if (value > _intsetGet(is,len-1)) {
+            if (pos) *pos = len;
             return 0;
         } else if (value < _intsetGet(is,0)) {
             if (pos) *pos = 0;
@@ -132,25 +203,194 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
-    while(max >= min) {
-        mid = ((unsigned int)min + (unsigned int)max) >> 1;
-        cur = _intsetGet(is,mid);
-        if (value > cur) {
-            min = mid+1;
-        } else if (value < cur) {
-            max = mid-1;
-        } else {
-            break;
+    idx = intsetLowerBound(is,0,len,value);
+    if (pos) *pos = idx;
+    return idx < len && _intsetGet(is,idx) == value;
+}
+
+/* Return the position of the first element >= "value" starting the search
+ * at position 'from', or the length of the set if there is none. The range
+ * is first bracketed with exponentially growing steps, so the cost depends
+ * on the distance from 'from' and not on the size of the set: this is what
+ * makes intersecting a small set with a much larger one cheap. */
+static uint32_t intsetGallop(intset *is, uint32_t from, int64_t value) {
+    uint32_t len = intrev32ifbe(is->length);
+    uint32_t lo = from, hi, step = 1;
+
+    if (lo >= len || _intsetGet(is,lo) >= value) return lo;
+    hi = lo+1;
+    while (hi < len && _intsetGet(is,hi) < value) {
+        lo = hi;
+        step <<= 1;
+        hi = (len-lo > step) ? lo+step : len;
+    }
+    return intsetLowerBound(is,lo+1,hi,value);
+}
+
+/* Create an intset with the given encoding and room for 'len' elements.
+ * The length is set to zero: the caller fills the set and then calls
+ * intsetSetOpFinish() with the final number of elements. */
+static intset *intsetNewSetOpResult(uint8_t enc, uint32_t len) {
+    intset *is = zmalloc(sizeof(intset)+(size_t)len*enc);
+    is->encoding = intrev32ifbe(enc);
+    is->length = 0;
+    return is;
+}
+
+static intset *intsetSetOpFinish(intset *is, uint32_t len) {
+    is->length = intrev32ifbe(len);
+    return intsetResize(is,len);
+}
+
+/* Append the elements of 'src' in the range [from,to) to 'dst' starting at
+ * position 'pos'. Returns the new number of elements of 'dst'. */
+static uint32_t intsetAppendRange(intset *dst, uint32_t pos, intset *src,
+                                  uint32_t from, uint32_t to)
+{
+    uint8_t denc = intrev32ifbe(dst->encoding);
+    uint8_t senc = intrev32ifbe(src->encoding);
+
+    if (from >= to) return pos;
+    if (denc == senc) {
+        memcpy(dst->contents+(size_t)pos*denc,
+               src->contents+(size_t)from*senc,(size_t)(to-from)*senc);
+        return pos+(to-from);
+    }
+    while (from < to) _intsetSet(dst,pos++,_intsetGetEncoded(src,from++,senc));
+    return pos;
+}
+
+/* Sets whose length differ by more than this factor are combined by
+ * galloping into the larger one instead of merging them linearly. */
+#define INTSET_GALLOP_RATIO 16
+
+/* Return a new intset with the elements that are both in 'a' and 'b'. */
+intset *intsetIntersection(intset *a, intset *b) {
+    if (intsetLen(a) > intsetLen(b)) {
+        intset *t = a; a = b; b = t;
+    }
+
+    uint32_t alen = intsetLen(a), blen = intsetLen(b);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    /* Common elements fit the smaller of the two encodings. */
+    intset *r = intsetNewSetOpResult(aenc < benc ? aenc : benc,alen);
+    uint32_t i = 0, j = 0, n = 0;
+
+    if ((uint64_t)alen*INTSET_GALLOP_RATIO < blen) {
+        for (i = 0; i < alen && j < blen; i++) {
+            int64_t v = _intsetGetEncoded(a,i,aenc);
+            j = intsetGallop(b,j,v);
+            if (j < blen && _intsetGetEncoded(b,j,benc) == v) {
+                _intsetSet(r,n++,v);
+                j++;
+            }
+        }
+    } else {
+        while (i < alen && j < blen) {
+            int64_t va = _intsetGetEncoded(a,i,aenc);
+            int64_t vb = _intsetGetEncoded(b,j,benc);
+            if (va < vb) {
+                i++;
+            } else if (va > vb) {
+                j++;
+            } else {
+                _intsetSet(r,n++,va);
+                i++;
+                j++;
+            }
         }
     }
+    return intsetSetOpFinish(r,n);
+}
 
-    if (value == cur) {
-        if (pos) *pos = mid;
-        return 1;
+/* Return a new intset with the elements that are in 'a', 'b' or both. */
+intset *intsetUnion(intset *a, intset *b) {
+    if (intsetLen(a) > intsetLen(b)) {
+        intset *t = a; a = b; b = t;
+    }
+
+    uint32_t alen = intsetLen(a), blen = intsetLen(b);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    intset *r = intsetNewSetOpResult(aenc > benc ? aenc : benc,alen+blen);
+    uint32_t i = 0, j = 0, n = 0;
+
+    if ((uint64_t)alen*INTSET_GALLOP_RATIO < blen) {
+        /* Copy the runs of 'b' between two elements of 'a' in bulk. */
+        for (i = 0; i < alen; i++) {
+            int64_t v = _intsetGetEncoded(a,i,aenc);
+            uint32_t k = intsetGallop(b,j,v);
+            n = intsetAppendRange(r,n,b,j,k);
+            if (k < blen && _intsetGetEncoded(b,k,benc) == v) k++;
+            _intsetSet(r,n++,v);
+            j = k;
+        }
     } else {
-        if (pos) *pos = min;
-        return 0;
+        while (i < alen && j < blen) {
+            int64_t va = _intsetGetEncoded(a,i,aenc);
+            int64_t vb = _intsetGetEncoded(b,j,benc);
+            if (va < vb) {
+                _intsetSet(r,n++,va);
+                i++;
+            } else if (va > vb) {
+                _intsetSet(r,n++,vb);
+                j++;
+            } else {
+                _intsetSet(r,n++,va);
+                i++;
+                j++;
+            }
+        }
+        n = intsetAppendRange(r,n,a,i,alen);
+    }
+    n = intsetAppendRange(r,n,b,j,blen);
+    return intsetSetOpFinish(r,n);
+}
+
+/* Return a new intset with the elements of 'a' that are not in 'b'. */
+intset *intsetDifference(intset *a, intset *b) {
+    uint32_t alen = intsetLen(a), blen = intsetLen(b);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    intset *r = intsetNewSetOpResult(aenc,alen);
+    uint32_t i = 0, j = 0, n = 0;
+
+    if ((uint64_t)alen*INTSET_GALLOP_RATIO < blen) {
+        /* Few elements to check against a large set: gallop into 'b'. */
+        for (i = 0; i < alen; i++) {
+            int64_t v = _intsetGetEncoded(a,i,aenc);
+            j = intsetGallop(b,j,v);
+            if (j < blen && _intsetGetEncoded(b,j,benc) == v)
+                j++;
+            else
+                _intsetSet(r,n++,v);
+        }
+    } else if ((uint64_t)blen*INTSET_GALLOP_RATIO < alen) {
+        /* Few elements to remove from a large set: gallop into 'a' and
+         * copy the runs between the removed elements in bulk. */
+        for (j = 0; j < blen && i < alen; j++) {
+            int64_t v = _intsetGetEncoded(b,j,benc);
+            uint32_t k = intsetGallop(a,i,v);
+            n = intsetAppendRange(r,n,a,i,k);
+            if (k < alen && _intsetGetEncoded(a,k,aenc) == v) k++;
+            i = k;
+        }
+        n = intsetAppendRange(r,n,a,i,alen);
+    } else {
+        while (i < alen && j < blen) {
+            int64_t va = _intsetGetEncoded(a,i,aenc);
+            int64_t vb = _intsetGetEncoded(b,j,benc);
+            if (va < vb) {
+                _intsetSet(r,n++,va);
+                i++;
+            } else if (va > vb) {
+                j++;
+            } else {
+                i++;
+                j++;
+            }
+        }
+        n = intsetAppendRange(r,n,a,i,alen);
     }
+    return intsetSetOpFinish(r,n);
 }
 
 /* Upgrades the intset to a larger encoding and inserts the given integer. */
@@ -348,6 +588,111 @@ static void checkConsistency(intset *is) {
     }
 }
 
+/* Random set of 'size' values in [base,base+span). */
+static intset *createRangeSet(int64_t base, uint64_t span, int size) {
+    intset *is = intsetNew();
+    for (int i = 0; i < size; i++) {
+        uint64_t r = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+        is = intsetAdd(is,base+(int64_t)(r % span),NULL);
+    }
+    return is;
+}
+
+/* The plain binary search, used as a reference for intsetSearch(). */
+static uint8_t intsetSearchRef(intset *is, int64_t value, uint32_t *pos) {
+    int min = 0, max = intrev32ifbe(is->length)-1, mid;
+    while (max >= min) {
+        int64_t cur;
+        mid = ((unsigned int)min + (unsigned int)max) >> 1;
+        cur = _intsetGet(is,mid);
+        if (value > cur) {
+            min = mid+1;
+        } else if (value < cur) {
+            max = mid-1;
+        } else {
+            *pos = mid;
+            return 1;
+        }
+    }
+    *pos = min;
+    return 0;
+}
+
+/* Set operations implemented by probing every element of 'a' into 'b', that
+ * is what SINTER and friends did with intsets before the merge kernels. */
+static intset *probeSetOp(intset *a, intset *b, int inter) {
+    intset *r = intsetNew();
+    for (uint32_t i = 0; i < intsetLen(a); i++) {
+        int64_t v = _intsetGet(a,i);
+        if (intsetFind(b,v) == inter) r = intsetAdd(r,v,NULL);
+    }
+    return r;
+}
+
+static intset *probeUnion(intset *a, intset *b) {
+    intset *r = intsetNew();
+    for (uint32_t i = 0; i < intsetLen(a); i++)
+        r = intsetAdd(r,_intsetGet(a,i),NULL);
+    for (uint32_t i = 0; i < intsetLen(b); i++)
+        r = intsetAdd(r,_intsetGet(b,i),NULL);
+    return r;
+}
+
+static int intsetEqual(intset *a, intset *b) {
+    if (intsetLen(a) != intsetLen(b)) return 0;
+    for (uint32_t i = 0; i < intsetLen(a); i++)
+        if (_intsetGet(a,i) != _intsetGet(b,i)) return 0;
+    return 1;
+}
+
+static void checkSetOps(intset *a, intset *b) {
+    intset *r, *ref;
+
+    r = intsetIntersection(a,b); ref = probeSetOp(a,b,1);
+    assert(intsetEqual(r,ref));
+    zfree(r); zfree(ref);
+    r = intsetUnion(a,b); ref = probeUnion(a,b);
+    assert(intsetEqual(r,ref));
+    if (intsetLen(r) > 1) checkConsistency(r);
+    zfree(r); zfree(ref);
+    r = intsetDifference(a,b); ref = probeSetOp(a,b,0);
+    assert(intsetEqual(r,ref));
+    zfree(r); zfree(ref);
+    r = intsetDifference(b,a); ref = probeSetOp(b,a,0);
+    assert(intsetEqual(r,ref));
+    zfree(r); zfree(ref);
+}
+
+static void benchmarkSetOps(int alen, int blen, uint64_t span) {
+    intset *a = createRangeSet(0,span,alen);
+    intset *b = createRangeSet(0,span,blen);
+    long long start, probe, kernel;
+    int iter = 1+(2000000/(alen+blen)), j;
+    const char *names[3] = {"inter","union","diff"};
+
+    for (int op = 0; op < 3; op++) {
+        start = usec();
+        for (j = 0; j < iter; j++) {
+            intset *r = op == 0 ? probeSetOp(a,b,1) :
+                        op == 1 ? probeUnion(a,b) : probeSetOp(a,b,0);
+            zfree(r);
+        }
+        probe = usec()-start;
+        start = usec();
+        for (j = 0; j < iter; j++) {
+            intset *r = op == 0 ? intsetIntersection(a,b) :
+                        op == 1 ? intsetUnion(a,b) : intsetDifference(a,b);
+            zfree(r);
+        }
+        kernel = usec()-start;
+        printf("    %u x %u %s: probe %.2f usec/op, kernel %.2f usec/op\n",
+            intsetLen(a),intsetLen(b),names[op],
+            (double)probe/iter,(double)kernel/iter);
+    }
+    zfree(a);
+    zfree(b);
+}
+
 #define UNUSED(x) (void)(x)
 int intsetTest(int argc, char **argv) {
     uint8_t success;
@@ -471,6 +816,80 @@ int intsetTest(int argc, char **argv) {
                num,size,usec()-start);
     }
 
+    printf("Search matches the reference binary search: "); {
+        int64_t bases[3] = {-1000, -100000, -10000000000LL};
+        uint64_t spans[3] = {3000, 300000, 30000000000ULL};
+        for (int e = 0; e < 3; e++) {
+            for (int size = 1; size < 300; size += 7) {
+                is = createRangeSet(bases[e],spans[e],size);
+                for (i = 0; i < 2000; i++) {
+                    uint32_t p1, p2;
+                    int64_t v = bases[e]-10+(rand()%(spans[e]+20));
+                    uint8_t f1 = intsetSearch(is,v,&p1);
+                    uint8_t f2 = intsetSearchRef(is,v,&p2);
+                    assert(f1 == f2 && p1 == p2);
+                }
+                for (uint32_t k = 0; k < intsetLen(is); k++) {
+                    uint32_t p;
+                    assert(intsetSearch(is,_intsetGet(is,k),&p) && p == k);
+                }
+                zfree(is);
+            }
+        }
+        ok();
+    }
+
+    printf("Intersection, union and difference: "); {
+        int sizes[6] = {0, 1, 20, 512, 2000, 20000};
+        for (int x = 0; x < 6; x++) {
+            for (int y = 0; y < 6; y++) {
+                /* Mix encodings: 'a' is int16, 'b' spans int16 to int64. */
+                intset *a = createRangeSet(-5000,10000,sizes[x]);
+                intset *b = createRangeSet(-5000,10000,sizes[y]);
+                checkSetOps(a,b);
+                zfree(b);
+                b = createRangeSet(-5000,10000,sizes[y]);
+                b = intsetAdd(b,100000,NULL);
+                b = intsetAdd(b,-10000000000LL,NULL);
+                checkSetOps(a,b);
+                zfree(a);
+                zfree(b);
+            }
+        }
+        ok();
+    }
+
+    printf("Set operations benchmark:\n"); {
+        benchmarkSetOps(512,512,2048);
+        benchmarkSetOps(512,65536,1<<20);
+        benchmarkSetOps(65536,65536,1<<18);
+        benchmarkSetOps(20,100000,1<<20);
+    }
+
+    printf("Lookup benchmark: "); {
+        long num = 1000000, size = 512;
+        uint32_t pos;
+        long long t1, t2;
+        int64_t *keys = zmalloc(sizeof(int64_t)*num);
+        is = createRangeSet(0,1<<16,size);
+        for (i = 0; i < num; i++) keys[i] = rand() % (1<<16);
+
+        for (int round = 0; round < 2; round++) {
+            long long start = usec();
+            long found = 0;
+            for (i = 0; i < num; i++) found += intsetSearchRef(is,keys[i],&pos);
+            t1 = usec()-start;
+            start = usec();
+            for (i = 0; i < num; i++) found += intsetSearch(is,keys[i],&pos);
+            t2 = usec()-start;
+            if (round == 1)
+                printf("%ld lookups, %u elements: binary %lldusec, "
+                       "new %lldusec (%ld)\n",num,intsetLen(is),t1,t2,found);
+        }
+        zfree(keys);
+        zfree(is);
+    }
+
     printf("Stress add+delete: "); {
         int i, v1, v2;
         is = intsetNew();
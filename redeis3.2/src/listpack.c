@@ -747,6 +747,89 @@ unsigned char *lpDelete(unsigned char *lp, unsigned char *p, unsigned char **new
     return lpInsert(lp,NULL,0,p,LP_REPLACE,newp);
 }
 
+/* Remove 'num' consecutive elements starting at the zero-based index 'index'
+ * (negative indexes are accepted, see lpSeek()), and return the resulting
+ * listpack. Unlike calling lpDelete() in a loop the tail of the listpack is
+ * moved only once. If 'index' is out of range the listpack is returned
+ * unmodified, while 'num' is truncated to the number of available elements. */
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned long num) {
+    unsigned char *first, *tail;
+    unsigned long deleted = 0;
+    uint32_t bytes = lpGetTotalBytes(lp);
+    uint32_t numele = lpGetNumElements(lp);
+
+    if (num == 0 || (first = lpSeek(lp,index)) == NULL) return lp;
+
+    tail = first;
+    while (deleted < num && tail[0] != LP_EOF) {
+        tail = lpSkip(tail);
+        deleted++;
+    }
+
+    /* Move the tail, including the EOF byte, over the deleted elements. */
+    memmove(first,tail,lp+bytes-tail);
+    bytes -= tail-first;
+    lpSetTotalBytes(lp,bytes);
+    if (numele != LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(lp,numele-deleted);
+    return lp_realloc(lp,bytes);
+}
+
+/* Return the element pointed by 'p' without converting integer encoded
+ * elements into strings. If the element is a string, a pointer to it is
+ * returned and its length is stored in '*slen'. Otherwise NULL is returned
+ * and the integer value is stored in '*lval'. This is the listpack
+ * equivalent of ziplistGet(). */
+unsigned char *lpGetValue(unsigned char *p, unsigned int *slen, long long *lval) {
+    int64_t v;
+    unsigned char *vstr = lpGet(p,&v,NULL);
+    if (vstr) *slen = v;
+    else *lval = v;
+    return vstr;
+}
+
+/* Return 1 if the element pointed by 'p' is equal to the string 's' of
+ * length 'slen', otherwise 0 is returned. Integer encoded elements are
+ * compared by value, so "10" matches an element stored as the integer 10. */
+int lpCompare(unsigned char *p, unsigned char *s, uint32_t slen) {
+    int64_t v, sval;
+    unsigned char *vstr = lpGet(p,&v,NULL);
+    if (vstr) return (uint64_t)v == slen && memcmp(vstr,s,slen) == 0;
+    return lpStringToInt64((const char*)s,slen,&sval) && sval == v;
+}
+
+/* Find the element equal to the string 's' of length 'slen', starting the
+ * scan at the element 'p' and then checking one element every 'skip'+1,
+ * so that for instance a listpack of field/value pairs can be searched by
+ * field only using skip = 1. Returns a pointer to the matching element or
+ * NULL if there is no match. The integer representation of 's' is computed
+ * at most once, the first time an integer encoded element is found. */
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, uint32_t slen, unsigned int skip) {
+    unsigned int skipcnt = 0;
+    int sencoding = 0; /* 0: not computed, 1: valid integer, 2: not integer. */
+    int64_t sval = 0;
+
+    while (p) {
+        if (skipcnt == 0) {
+            int64_t v;
+            unsigned char *vstr = lpGet(p,&v,NULL);
+            if (vstr) {
+                if ((uint64_t)v == slen && memcmp(vstr,s,slen) == 0) return p;
+            } else {
+                if (sencoding == 0)
+                    sencoding = lpStringToInt64((const char*)s,slen,&sval) ?
+                                1 : 2;
+                if (sencoding == 1 && v == sval) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpNext(lp,p);
+    }
+    return NULL;
+}
+
 /* Return the total number of bytes the listpack is composed of. */
 uint32_t lpBytes(unsigned char *lp) {
     return lpGetTotalBytes(lp);
@@ -801,3 +884,144 @@ unsigned char *lpSeek(unsigned char *lp, long index) {
     }
 }
 
+#ifdef REDIS_TEST
+#include <assert.h>
+#include <sys/time.h>
+#include "ziplist.h"
+
+#define UNUSED(x) (void)(x)
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Compare the cost of inserting and then deleting an element at the head of
+ * a ziplist and of a listpack holding 'count' elements of 'size' bytes, the
+ * typical small hash/zset update pattern. Every iteration works on a fresh
+ * copy of the container (the copy is timed for both encodings), since after
+ * the first cascading update a ziplist keeps its larger prevlen fields.
+ * With 'size' in the 250-253 range every ziplist insertion of an element
+ * larger than 253 bytes cascades through all the following entries, while
+ * listpack entries only encode their own length. */
+static void benchmarkInsertDelete(int count, int size, int newsize, int iter) {
+    unsigned char *ele = lp_malloc(size > newsize ? size : newsize);
+    unsigned char *zl = ziplistNew(), *lp = lpNew(), *copy;
+    long long start, zlus, lpus;
+    size_t bytes;
+    int j;
+
+    memset(ele,'x',size > newsize ? size : newsize);
+    for (j = 0; j < count; j++) {
+        zl = ziplistPush(zl,ele,size,ZIPLIST_TAIL);
+        lp = lpAppend(lp,ele,size);
+    }
+
+    bytes = ziplistBlobLen(zl);
+    start = usec();
+    for (j = 0; j < iter; j++) {
+        copy = lp_malloc(bytes);
+        memcpy(copy,zl,bytes);
+        copy = ziplistPush(copy,ele,newsize,ZIPLIST_HEAD);
+        copy = ziplistDeleteRange(copy,0,1);
+        lp_free(copy);
+    }
+    zlus = usec()-start;
+
+    bytes = lpBytes(lp);
+    start = usec();
+    for (j = 0; j < iter; j++) {
+        copy = lp_malloc(bytes);
+        memcpy(copy,lp,bytes);
+        copy = lpInsert(copy,ele,newsize,lpFirst(copy),LP_BEFORE,NULL);
+        copy = lpDelete(copy,lpFirst(copy),NULL);
+        lp_free(copy);
+    }
+    lpus = usec()-start;
+
+    printf("%d entries of %d bytes, insert+delete %d bytes at head: "
+           "ziplist %.2f usec/op, listpack %.2f usec/op\n",
+           count, size, newsize, (double)zlus/iter, (double)lpus/iter);
+    zfree(zl);
+    lpFree(lp);
+    lp_free(ele);
+}
+
+int listpackTest(int argc, char *argv[]) {
+    unsigned char *lp, *p, *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+    int j, len;
+
+    UNUSED(argc);
+    UNUSED(argv);
+
+    printf("Find, compare and get elements: ");
+    {
+        lp = lpNew();
+        lp = lpAppend(lp,(unsigned char*)"field1",6);
+        lp = lpAppend(lp,(unsigned char*)"1024",4);
+        lp = lpAppend(lp,(unsigned char*)"field2",6);
+        lp = lpAppend(lp,(unsigned char*)"hello",5);
+
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"field2",6,1);
+        assert(p != NULL && lpCompare(p,(unsigned char*)"field2",6));
+        vstr = lpGetValue(lpNext(lp,p),&vlen,&vll);
+        assert(vstr != NULL && vlen == 5 && !memcmp(vstr,"hello",5));
+
+        /* With skip = 1 only the fields are compared. */
+        assert(lpFind(lp,lpFirst(lp),(unsigned char*)"1024",4,1) == NULL);
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"1024",4,0);
+        assert(p != NULL);
+        vstr = lpGetValue(p,&vlen,&vll);
+        assert(vstr == NULL && vll == 1024);
+
+        /* Integer encoded elements compare by value. */
+        assert(lpCompare(p,(unsigned char*)"1024",4));
+        assert(!lpCompare(p,(unsigned char*)"01024",5));
+        assert(!lpCompare(p,(unsigned char*)"1025",4));
+        lpFree(lp);
+        printf("[ok]\n");
+    }
+
+    printf("Delete range: ");
+    {
+        lp = lpNew();
+        for (j = 0; j < 10; j++) {
+            len = snprintf(buf,sizeof(buf),"%d",j);
+            lp = lpAppend(lp,(unsigned char*)buf,len);
+        }
+        lp = lpDeleteRange(lp,2,3);
+        assert(lpLength(lp) == 7);
+        vstr = lpGetValue(lpSeek(lp,2),&vlen,&vll);
+        assert(vstr == NULL && vll == 5);
+
+        /* Ranges past the tail are truncated. */
+        lp = lpDeleteRange(lp,-2,10);
+        assert(lpLength(lp) == 5);
+        vstr = lpGetValue(lpLast(lp),&vlen,&vll);
+        assert(vstr == NULL && vll == 7);
+        vstr = lpGetValue(lpPrev(lp,lpLast(lp)),&vlen,&vll);
+        assert(vstr == NULL && vll == 6);
+
+        /* Out of range index is a no-op. */
+        lp = lpDeleteRange(lp,5,1);
+        assert(lpLength(lp) == 5);
+        lp = lpDeleteRange(lp,0,5);
+        assert(lpLength(lp) == 0 && lpFirst(lp) == NULL);
+        assert(lpBytes(lp) == LP_HDR_SIZE+1);
+        lpFree(lp);
+        printf("[ok]\n");
+    }
+
+    printf("Benchmark insert/delete on 512 entries:\n");
+    {
+        benchmarkInsertDelete(512,8,8,20000);
+        benchmarkInsertDelete(512,64,64,20000);
+        benchmarkInsertDelete(512,250,254,2000);
+    }
+    return 0;
+}
+#endif
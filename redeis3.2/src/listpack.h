@@ -57,5 +57,13 @@ unsigned char *lpNext(unsigned char *lp, unsigned char *p);
 unsigned char *lpPrev(unsigned char *lp, unsigned char *p);
 uint32_t lpBytes(unsigned char *lp);
 unsigned char *lpSeek(unsigned char *lp, long index);
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned long num);
+unsigned char *lpGetValue(unsigned char *p, unsigned int *slen, long long *lval);
+int lpCompare(unsigned char *p, unsigned char *s, uint32_t slen);
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, uint32_t slen, unsigned int skip);
+
+#ifdef REDIS_TEST
+int listpackTest(int argc, char *argv[]);
+#endif
 
 #endif
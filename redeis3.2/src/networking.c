@@ -261,11 +261,23 @@ int prepareClientToWrite(client *c) {
  * Low level functions to add more data to output buffers.
  * -------------------------------------------------------------------------- */
 
+/* True if the reply can be handed to the Lua direct conversion without going
+ * through the protocol: not while a previous element emitted as raw
+ * protocol is still incomplete. */
+#define luaDirectReply(c) (((c)->flags & CLIENT_LUA_DIRECT_REPLY) && \
+                           !luaReplyIsPending())
+
 int _addReplyToBuffer(client *c, const char *s, size_t len) {
     size_t available = sizeof(c->buf)-c->bufpos;
 
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return C_OK;
 
+    /* Replies to redis.call() are converted into Lua values directly. */
+    if (c->flags & CLIENT_LUA_DIRECT_REPLY) {
+        luaReplyProto(s,len);
+        return C_OK;
+    }
+
     /* If there already are entries in the reply list, we cannot
      * add anything more to the static buffer. */
     if (listLength(c->reply) > 0) return C_ERR;
@@ -278,7 +290,12 @@ int _addReplyToBuffer(client *c, const char *s, size_t len) {
     return C_OK;
 }
 
-void _addReplyProtoToList(client *c, const char *s, size_t len) {
+/* Append the protocol to the reply list of the client, without checking the
+ * output buffer limits. Unlike _addReplyProtoToList() this only touches the
+ * client itself, so it is also called from the I/O threads. */
+static void _addReplyProtoToListNoLimitCheck(client *c, const char *s,
+                                             size_t len)
+{
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
 
     listNode *ln = listLast(c->reply);
@@ -311,6 +328,11 @@ void _addReplyProtoToList(client *c, const char *s, size_t len) {
         listAddNodeTail(c->reply, tail);
         c->reply_bytes += tail->size;
     }
+}
+
+void _addReplyProtoToList(client *c, const char *s, size_t len) {
+    if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
+    _addReplyProtoToListNoLimitCheck(c,s,len);
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
@@ -376,6 +398,10 @@ void addReplyProto(client *c, const char *s, size_t len) {
  * error code is automatically added.
  * Note that 's' must NOT end with \r\n. */
 void addReplyErrorLength(client *c, const char *s, size_t len) {
+    if (luaDirectReply(c)) {
+        luaReplyStatus(s,len,'-');
+        return;
+    }
     /* If the string already starts with "-..." then the error code
      * is provided by the caller. Otherwise we use "-ERR". */
     if (!len || s[0] != '-') addReplyProto(c,"-ERR ",5);
@@ -461,6 +487,10 @@ void addReplyErrorFormat(client *c, const char *fmt, ...) {
 }
 
 void addReplyStatusLength(client *c, const char *s, size_t len) {
+    if (luaDirectReply(c)) {
+        luaReplyStatus(s,len,'+');
+        return;
+    }
     addReplyProto(c,"+",1);
     addReplyProto(c,s,len);
     addReplyProto(c,"\r\n",2);
@@ -514,6 +544,7 @@ void *addReplyDeferredLen(client *c) {
      * ready to be sent, since we are sure that before returning to the
      * event loop setDeferredAggregateLen() will be called. */
     if (prepareClientToWrite(c) != C_OK) return NULL;
+    if (c->flags & CLIENT_LUA_DIRECT_REPLY) return luaReplyDeferredLen();
     trimReplyUnusedTailSpace(c);
     listAddNodeTail(c->reply,NULL); /* NULL is our placeholder. */
     return listLast(c->reply);
@@ -530,6 +561,10 @@ void setDeferredAggregateLen(client *c, void *node, long length, char prefix) {
     /* Abort when *node is NULL: when the client should not accept writes
      * we return NULL in addReplyDeferredLen() */
     if (node == NULL) return;
+    if (c->flags & CLIENT_LUA_DIRECT_REPLY) {
+        luaReplySetDeferredLen(node,length,prefix);
+        return;
+    }
     serverAssert(!listNodeValue(ln));
 
     /* Normally we fill this dummy NULL node, added by addReplyDeferredLen(),
@@ -656,7 +691,9 @@ void addReplyLongLongWithPrefix(client *c, long long ll, char prefix) {
 }
 
 void addReplyLongLong(client *c, long long ll) {
-    if (ll == 0)
+    if (luaDirectReply(c))
+        luaReplyLongLong(ll);
+    else if (ll == 0)
         addReply(c,shared.czero);
     else if (ll == 1)
         addReply(c,shared.cone);
@@ -665,7 +702,9 @@ void addReplyLongLong(client *c, long long ll) {
 }
 
 void addReplyAggregateLen(client *c, long length, int prefix) {
-    if (prefix == '*' && length < OBJ_SHARED_BULKHDR_LEN)
+    if (luaDirectReply(c) && (prefix == '*' || prefix == '%' || prefix == '~'))
+        luaReplyAggregateLen(length,prefix);
+    else if (prefix == '*' && length < OBJ_SHARED_BULKHDR_LEN)
         addReply(c,shared.mbulkhdr[length]);
     else
         addReplyLongLongWithPrefix(c,length,prefix);
@@ -737,6 +776,15 @@ void addReplyBulkLen(client *c, robj *obj) {
 
 /* Add a Redis Object as a bulk reply */
 void addReplyBulk(client *c, robj *obj) {
+    if (luaDirectReply(c)) {
+        if (sdsEncodedObject(obj)) {
+            luaReplyString(obj->ptr,sdslen(obj->ptr));
+        } else {
+            char buf[LONG_STR_SIZE];
+            luaReplyString(buf,ll2string(buf,sizeof(buf),(long)obj->ptr));
+        }
+        return;
+    }
     addReplyBulkLen(c,obj);
     addReply(c,obj);
     addReply(c,shared.crlf);
@@ -744,6 +792,10 @@ void addReplyBulk(client *c, robj *obj) {
 
 /* Add a C buffer as bulk reply */
 void addReplyBulkCBuffer(client *c, const void *p, size_t len) {
+    if (luaDirectReply(c)) {
+        luaReplyString(p,len);
+        return;
+    }
     addReplyLongLongWithPrefix(c,len,'$');
     addReplyProto(c,p,len);
     addReply(c,shared.crlf);
@@ -751,6 +803,11 @@ void addReplyBulkCBuffer(client *c, const void *p, size_t len) {
 
 /* Add sds to reply (takes ownership of sds and frees it) */
 void addReplyBulkSds(client *c, sds s)  {
+    if (luaDirectReply(c)) {
+        luaReplyString(s,sdslen(s));
+        sdsfree(s);
+        return;
+    }
     addReplyLongLongWithPrefix(c,sdslen(s),'$');
     addReplySds(c,s);
     addReply(c,shared.crlf);
@@ -3042,11 +3099,19 @@ int tio_debug = 0;
 #define IO_THREADS_MAX_NUM 128
 #define IO_THREADS_OP_READ 0
 #define IO_THREADS_OP_WRITE 1
+#define IO_THREADS_OP_FANOUT 2
 
 pthread_t io_threads[IO_THREADS_MAX_NUM];
 pthread_mutex_t io_threads_mutex[IO_THREADS_MAX_NUM];
 redisAtomic unsigned long io_threads_pending[IO_THREADS_MAX_NUM];
-int io_threads_op;      /* IO_THREADS_OP_WRITE or IO_THREADS_OP_READ. */
+int io_threads_op;      /* IO_THREADS_OP_WRITE, _READ or _FANOUT. */
+
+/* The fan-out in progress, see addReplyToClientsUsingThreads(): thread 'j'
+ * appends the reply to the clients from io_threads_fanout_slice[j] to
+ * io_threads_fanout_slice[j+1] (excluded) of io_threads_fanout_clients. */
+client **io_threads_fanout_clients;
+robj **io_threads_fanout_replies;
+size_t io_threads_fanout_slice[IO_THREADS_MAX_NUM+1];
 
 /* This is the list of clients each thread will serve when threaded I/O is
  * used. We spawn io_threads_num-1 threads, since one is the main thread
@@ -3063,6 +3128,19 @@ static inline void setIOPendingCount(int i, unsigned long count) {
     atomicSetWithSync(io_threads_pending[i], count);
 }
 
+/* Append the fan-out reply to the slice of clients of the thread 'id'. */
+static void fanoutReplySlice(int id) {
+    for (size_t j = io_threads_fanout_slice[id];
+         j < io_threads_fanout_slice[id+1]; j++)
+    {
+        client *c = io_threads_fanout_clients[j];
+        sds reply = io_threads_fanout_replies[c->resp == 2 ? 0 : 1]->ptr;
+
+        if (_addReplyToBuffer(c,reply,sdslen(reply)) != C_OK)
+            _addReplyProtoToListNoLimitCheck(c,reply,sdslen(reply));
+    }
+}
+
 void *IOThreadMain(void *myid) {
     /* The ID is the thread number (from 0 to server.iothreads_num-1), and is
      * used by the thread to just manipulate a single sub-array of clients. */
@@ -3093,6 +3171,11 @@ void *IOThreadMain(void *myid) {
 
         /* Process: note that the main thread will never touch our list
          * before we drop the pending count to 0. */
+        if (io_threads_op == IO_THREADS_OP_FANOUT) {
+            fanoutReplySlice(id);
+            setIOPendingCount(id, 0);
+            continue;
+        }
         listIter li;
         listNode *ln;
         listRewind(io_threads_list[id],&li);
@@ -3292,6 +3375,71 @@ int handleClientsWithPendingWritesUsingThreads(void) {
     return processed;
 }
 
+/* Append the same already encoded reply to all the clients of the list,
+ * splitting the copy among the I/O threads: this is used to deliver a
+ * Pub/Sub message to channels with many subscribers, where appending the
+ * message to every output buffer dominates the cost of PUBLISH.
+ *
+ * 'replies' holds two sds encoded objects: the reply for RESP2 clients and
+ * the one for RESP3 clients. The clients are prepared for the write in the
+ * main thread, since that touches the global list of clients with pending
+ * writes, then each thread copies the reply into a contiguous slice of
+ * clients, and finally the output buffer limits are checked again in the
+ * main thread. Without I/O threads the clients are served one by one. */
+void addReplyToClientsUsingThreads(list *clients, robj **replies) {
+    unsigned long numclients = 0;
+    listIter li;
+    listNode *ln;
+
+    if (server.io_threads_num == 1) {
+        listRewind(clients,&li);
+        while((ln = listNext(&li))) {
+            client *c = listNodeValue(ln);
+            addReply(c,replies[c->resp == 2 ? 0 : 1]);
+        }
+        return;
+    }
+
+    io_threads_fanout_clients = zmalloc(sizeof(client*)*listLength(clients));
+    io_threads_fanout_replies = replies;
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (prepareClientToWrite(c) != C_OK) continue;
+        io_threads_fanout_clients[numclients++] = c;
+    }
+
+    /* Start threads if needed. */
+    if (!server.io_threads_active) startThreadedIO();
+
+    for (int j = 0; j <= server.io_threads_num; j++)
+        io_threads_fanout_slice[j] = numclients*j/server.io_threads_num;
+    io_threads_op = IO_THREADS_OP_FANOUT;
+    for (int j = 1; j < server.io_threads_num; j++) {
+        setIOPendingCount(j,
+            io_threads_fanout_slice[j+1]-io_threads_fanout_slice[j]);
+    }
+
+    /* Also use the main thread to process a slice of clients. */
+    fanoutReplySlice(0);
+
+    /* Wait for all the other threads to end their work. */
+    while(1) {
+        unsigned long pending = 0;
+        for (int j = 1; j < server.io_threads_num; j++)
+            pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+
+    for (unsigned long j = 0; j < numclients; j++) {
+        client *c = io_threads_fanout_clients[j];
+        asyncCloseClientOnOutputBufferLimitReached(c);
+    }
+    zfree(io_threads_fanout_clients);
+    io_threads_fanout_clients = NULL;
+    io_threads_fanout_replies = NULL;
+}
+
 /* Return 1 if we want to handle the client read later using threaded I/O.
  * This is called by the readable handler of the event loop.
  * As a side effect of calling this function the client is put in the
@@ -120,6 +120,121 @@ void addReplyPubsubPatUnsubscribed(client *c, robj *pattern) {
     addReplyLongLong(c,clientSubscriptionsCount(c));
 }
 
+/* Return the full RESP encoding of a "message" (if 'pat' is NULL) or
+ * "pmessage" push, as addReplyPubsubMessage() and addReplyPubsubPatMessage()
+ * would emit it for a client using the protocol version 'resp'. The
+ * arguments must be sds encoded objects.
+ *
+ * When a message is published to many clients it is encoded just once per
+ * protocol version, and every subscriber just gets a copy of the bytes. */
+static robj *pubsubEncodeMessage(int resp, robj *pat, robj *channel,
+                                 robj *msg)
+{
+    robj *parts[3] = {pat, channel, msg};
+    sds s = sdsempty();
+
+    s = sdscatfmt(s,"%s%i\r\n",resp == 2 ? "*" : ">",pat ? 4 : 3);
+    s = sdscatsds(s,pat ? shared.pmessagebulk->ptr : shared.messagebulk->ptr);
+    for (int j = pat ? 0 : 1; j < 3; j++) {
+        sds part = parts[j]->ptr;
+        s = sdscatfmt(s,"$%U\r\n",(unsigned long long)sdslen(part));
+        s = sdscatsds(s,part);
+        s = sdscatlen(s,"\r\n",2);
+    }
+    return createObject(OBJ_STRING,s);
+}
+
+/* Send the clients of 'list' the message, encoding it lazily into 'enc',
+ * that holds the RESP2 and RESP3 versions. Returns the number of clients. */
+static int pubsubDeliverEncoded(list *clients, robj *enc[2], robj *pat,
+                                robj *channel, robj *msg)
+{
+    listNode *ln;
+    listIter li;
+    int receivers = 0;
+
+    /* With many subscribers let the I/O threads copy the message. */
+    if (server.io_threads_num > 1 &&
+        listLength(clients) >= PUBSUB_THREADED_FANOUT_MIN_CLIENTS)
+    {
+        for (int j = 0; j < 2; j++) {
+            if (enc[j] == NULL)
+                enc[j] = pubsubEncodeMessage(j == 0 ? 2 : 3,pat,channel,msg);
+        }
+        addReplyToClientsUsingThreads(clients,enc);
+        return listLength(clients);
+    }
+
+    listRewind(clients,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        client *c = listNodeValue(ln);
+        int idx = c->resp == 2 ? 0 : 1;
+
+        if (enc[idx] == NULL)
+            enc[idx] = pubsubEncodeMessage(c->resp,pat,channel,msg);
+        addReply(c,enc[idx]);
+        receivers++;
+    }
+    return receivers;
+}
+
+static void pubsubReleaseEncoded(robj *enc[2]) {
+    for (int j = 0; j < 2; j++) {
+        if (enc[j]) decrRefCount(enc[j]);
+        enc[j] = NULL;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Pattern index
+ *
+ * Matching every pattern against the channel on PUBLISH does not scale with
+ * the number of patterns. Patterns are instead grouped by their literal
+ * prefix, that is everything before the first glob special character, in
+ * the radix tree server.pubsub_patterns_index: a pattern can only match
+ * channels starting with its literal prefix, so PUBLISH only needs to test
+ * the patterns stored under the prefixes of the channel name. Patterns
+ * starting with a special character are stored under the empty prefix and
+ * are always tested.
+ *----------------------------------------------------------------------------*/
+
+static size_t pubsubPatternLiteralPrefixLen(sds pattern) {
+    size_t j, len = sdslen(pattern);
+
+    for (j = 0; j < len; j++) {
+        char c = pattern[j];
+        if (c == '*' || c == '?' || c == '[' || c == '\\') break;
+    }
+    return j;
+}
+
+/* Add a pattern of server.pubsub_patterns_dict, with the list of its
+ * clients, to the index. */
+static void pubsubIndexPattern(robj *pattern, list *clients) {
+    size_t plen = pubsubPatternLiteralPrefixLen(pattern->ptr);
+    dict *bucket = raxFind(server.pubsub_patterns_index,pattern->ptr,plen);
+
+    if (bucket == raxNotFound) {
+        bucket = dictCreate(&pubsubPatternIndexDictType,NULL);
+        raxInsert(server.pubsub_patterns_index,pattern->ptr,plen,bucket,NULL);
+    }
+    dictAdd(bucket,pattern,clients);
+}
+
+/* Remove a pattern from the index, before it is removed from
+ * server.pubsub_patterns_dict. */
+static void pubsubUnindexPattern(robj *pattern) {
+    size_t plen = pubsubPatternLiteralPrefixLen(pattern->ptr);
+    dict *bucket = raxFind(server.pubsub_patterns_index,pattern->ptr,plen);
+
+    serverAssert(bucket != raxNotFound);
+    serverAssert(dictDelete(bucket,pattern) == DICT_OK);
+    if (dictSize(bucket) == 0) {
+        dictRelease(bucket);
+        raxRemove(server.pubsub_patterns_index,pattern->ptr,plen,NULL);
+    }
+}
+
 /*-----------------------------------------------------------------------------
  * Pubsub low level API
  *----------------------------------------------------------------------------*/
@@ -225,6 +340,7 @@ int pubsubSubscribePattern(client *c, robj *pattern) {
             clients = listCreate();
             dictAdd(server.pubsub_patterns_dict,pattern,clients);
             incrRefCount(pattern);
+            pubsubIndexPattern(pattern,clients);
         } else {
             clients = dictGetVal(de);
         }
@@ -262,6 +378,7 @@ int pubsubUnsubscribePattern(client *c, robj *pattern, int notify) {
         if (listLength(clients) == 0) {
             /* Free the list and associated hash entry at all if this was
              * the latest client. */
+            pubsubUnindexPattern(pattern);
             dictDelete(server.pubsub_patterns_dict,pattern);
         }
     }
@@ -306,50 +423,66 @@ int pubsubUnsubscribeAllPatterns(client *c, int notify) {
     return count;
 }
 
+/* State of the pattern index walk performed by pubsubPublishMessage(). */
+typedef struct pubsubPatternWalk {
+    robj *channel;      /* Decoded channel. */
+    robj *message;      /* Decoded message. */
+    robj **enc;         /* Encoded messages cache, see pubsubDeliverEncoded(). */
+    int receivers;
+} pubsubPatternWalk;
+
+/* raxWalkPrefixes() callback: deliver the message to the patterns of the
+ * bucket indexed under a prefix of the channel, that match the channel. */
+static int pubsubPublishToBucket(void *privdata, size_t keylen, void *data) {
+    pubsubPatternWalk *walk = privdata;
+    sds chan = walk->channel->ptr;
+    dictIterator *di = dictGetIterator(data);
+    dictEntry *de;
+    UNUSED(keylen);
+
+    while((de = dictNext(di)) != NULL) {
+        robj *pattern = dictGetKey(de);
+        if (!stringmatchlen((char*)pattern->ptr,
+                            sdslen(pattern->ptr),
+                            chan,sdslen(chan),0)) continue;
+
+        walk->receivers += pubsubDeliverEncoded(dictGetVal(de),walk->enc,
+                                                pattern,walk->channel,
+                                                walk->message);
+        pubsubReleaseEncoded(walk->enc);
+    }
+    dictReleaseIterator(di);
+    return 1;
+}
+
 /* Publish a message */
 int pubsubPublishMessage(robj *channel, robj *message) {
     int receivers = 0;
     dictEntry *de;
-    dictIterator *di;
-    listNode *ln;
-    listIter li;
+    robj *enc[2] = {NULL,NULL}; /* RESP2 and RESP3 encoded message. */
+
+    channel = getDecodedObject(channel);
+    message = getDecodedObject(message);
 
     /* Send to clients listening for that channel */
     de = dictFind(server.pubsub_channels,channel);
     if (de) {
-        list *list = dictGetVal(de);
-        listNode *ln;
-        listIter li;
-
-        listRewind(list,&li);
-        while ((ln = listNext(&li)) != NULL) {
-            client *c = ln->value;
-            addReplyPubsubMessage(c,channel,message);
-            receivers++;
-        }
+        receivers += pubsubDeliverEncoded(dictGetVal(de),enc,NULL,
+                                          channel,message);
+        pubsubReleaseEncoded(enc);
     }
-    /* Send to clients listening to matching channels */
-    di = dictGetIterator(server.pubsub_patterns_dict);
-    if (di) {
-        channel = getDecodedObject(channel);
-        while((de = dictNext(di)) != NULL) {
-            robj *pattern = dictGetKey(de);
-            list *clients = dictGetVal(de);
-            if (!stringmatchlen((char*)pattern->ptr,
-                                sdslen(pattern->ptr),
-                                (char*)channel->ptr,
-                                sdslen(channel->ptr),0)) continue;
-
-            listRewind(clients,&li);
-            while ((ln = listNext(&li)) != NULL) {
-                client *c = listNodeValue(ln);
-                addReplyPubsubPatMessage(c,pattern,channel,message);
-                receivers++;
-            }
-        }
-        decrRefCount(channel);
-        dictReleaseIterator(di);
+
+    /* Send to clients listening to matching channels: only the patterns
+     * indexed under a prefix of the channel name can match, and these are
+     * found descending the index a single time along the channel name. */
+    if (raxSize(server.pubsub_patterns_index)) {
+        pubsubPatternWalk walk = {channel,message,enc,0};
+        raxWalkPrefixes(server.pubsub_patterns_index,channel->ptr,
+                        sdslen(channel->ptr),pubsubPublishToBucket,&walk);
+        receivers += walk.receivers;
     }
+    decrRefCount(channel);
+    decrRefCount(message);
     return receivers;
 }
 
@@ -1194,6 +1194,49 @@ int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
     }
 }
 
+/* Visit 'count' entries starting at index 'start' (see quicklistIndex())
+ * towards the tail, one node at a time: each node is decompressed only once
+ * and 'fn' is called with the ziplist of the node and the number of entries
+ * to visit in it, so the caller can walk the entries with ziplistNext()
+ * instead of paying the quicklistNext() overhead for every entry.
+ *
+ * The quicklist must not be modified by 'fn'.
+ * Returns the number of entries visited. */
+unsigned long quicklistRangeByNode(quicklist *quicklist, const long long start,
+                                   unsigned long count, quicklistRangeFn *fn,
+                                   void *privdata) {
+    quicklistEntry entry;
+    quicklistNode *node;
+    unsigned char *p;
+    unsigned long offset, visited = 0;
+
+    if (!count || !quicklistIndex(quicklist, start, &entry))
+        return 0;
+
+    /* quicklistIndex() left the first node decompressed for use. */
+    node = entry.node;
+    p = entry.zi;
+    offset = entry.offset >= 0 ? (unsigned long)entry.offset
+                               : node->count - (unsigned long)-entry.offset;
+    while (node && visited < count) {
+        unsigned long n = node->count - offset;
+
+        if (!p) {
+            quicklistDecompressNodeForUse(node);
+            p = ziplistIndex(node->zl, 0);
+        }
+        if (n > count - visited)
+            n = count - visited;
+        fn(privdata, node->zl, p, n);
+        visited += n;
+        quicklistCompress(quicklist, node);
+        node = node->next;
+        p = NULL;
+        offset = 0;
+    }
+    return visited;
+}
+
 /* Duplicate the quicklist.
  * On success a copy of the original quicklist is returned.
  *
@@ -1706,6 +1749,46 @@ static char *genstr(char *prefix, int i) {
     return result;
 }
 
+/* State of the quicklistRangeByNode() test callbacks. */
+typedef struct rangeState {
+    int next;               /* Expected suffix of the next "hello" entry. */
+    unsigned long visited;  /* Entries visited so far. */
+    unsigned long errors;   /* Entries not matching the expected value. */
+    size_t bytes;           /* Total length of the visited entries. */
+} rangeState;
+
+/* Checks the entries of a list of "hello<n>" pushed at head with n
+ * increasing, so that entries are visited with n decreasing. */
+static void rangeCheckFn(void *privdata, unsigned char *zl, unsigned char *p,
+                         unsigned long count) {
+    rangeState *rs = privdata;
+    while (count--) {
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vlong;
+        ziplistGet(p, &vstr, &vlen, &vlong);
+        if (!vstr || strcmp((char *)vstr, genstr("hello", rs->next)))
+            rs->errors++;
+        rs->next--;
+        rs->visited++;
+        p = ziplistNext(zl, p);
+    }
+}
+
+static void rangeSumFn(void *privdata, unsigned char *zl, unsigned char *p,
+                       unsigned long count) {
+    rangeState *rs = privdata;
+    while (count--) {
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vlong;
+        ziplistGet(p, &vstr, &vlen, &vlong);
+        rs->bytes += vstr ? vlen : sizeof(vlong);
+        rs->visited++;
+        p = ziplistNext(zl, p);
+    }
+}
+
 /* main test, but callable from other files */
 int quicklistTest(int argc, char *argv[]) {
     UNUSED(argc);
@@ -1958,6 +2041,32 @@ int quicklistTest(int argc, char *argv[]) {
             quicklistRelease(ql);
         }
 
+        TEST("range by node over 500 list") {
+            quicklist *ql = quicklistNew(-2, options[_i]);
+            quicklistSetFill(ql, 32);
+            for (int i = 0; i < 500; i++)
+                quicklistPushHead(ql, genstr("hello", i), 32);
+            long long starts[] = {0, 1, 31, 32, 250, 499, -1, -33, -500};
+            for (size_t s = 0; s < sizeof(starts) / sizeof(*starts); s++) {
+                long long first = starts[s] < 0 ? 500 + starts[s] : starts[s];
+                rangeState rs = {499 - first, 0, 0, 0};
+                unsigned long visited =
+                    quicklistRangeByNode(ql, starts[s], 100, rangeCheckFn, &rs);
+                unsigned long expected = 500 - first < 100 ? 500 - first : 100;
+                if (visited != expected || rs.visited != expected)
+                    ERR("Visited %lu (%lu) entries from %lld, expected %lu",
+                        visited, rs.visited, starts[s], expected);
+                if (rs.errors)
+                    ERR("%lu entries didn't match from %lld", rs.errors,
+                        starts[s]);
+            }
+            rangeState rs = {0, 0, 0, 0};
+            if (quicklistRangeByNode(ql, 500, 10, rangeCheckFn, &rs) != 0)
+                ERR("Visited %lu entries out of range", rs.visited);
+            ql_verify(ql, 16, 500, 20, 32);
+            quicklistRelease(ql);
+        }
+
         TEST("iterate reverse over 500 list") {
             quicklist *ql = quicklistNew(-2, options[_i]);
             quicklistSetFill(ql, 32);
@@ -2739,6 +2848,49 @@ int quicklistTest(int argc, char *argv[]) {
     printf("Compressions: %0.2f seconds.\n", (float)(stop - start) / 1000);
     printf("\n");
 
+    /* Compare iterating ranges with quicklistNext() and by node, as done by
+     * LRANGE, on uncompressed and compressed lists. */
+    for (int depth = 0; depth <= 1; depth++) {
+        TEST_DESC("benchmark range of 1000 from 100k list at compress %d",
+                  depth) {
+            quicklist *ql = quicklistNew(-2, depth);
+            for (int i = 0; i < 100000; i++)
+                quicklistPushTail(ql, genstr("hello", i), 16);
+            const int loops = 2000;
+            rangeState by_entry = {0, 0, 0, 0}, by_node = {0, 0, 0, 0};
+
+            long long start = ustime();
+            for (int j = 0; j < loops; j++) {
+                quicklistIter *iter = quicklistGetIteratorAtIdx(
+                    ql, AL_START_HEAD, (j * 997) % 99000);
+                quicklistEntry entry;
+                for (int k = 0; k < 1000 && quicklistNext(iter, &entry); k++) {
+                    by_entry.bytes +=
+                        entry.value ? entry.sz : sizeof(entry.longval);
+                    by_entry.visited++;
+                }
+                quicklistReleaseIterator(iter);
+            }
+            long long entry_us = ustime() - start;
+
+            start = ustime();
+            for (int j = 0; j < loops; j++)
+                quicklistRangeByNode(ql, (j * 997) % 99000, 1000, rangeSumFn,
+                                     &by_node);
+            long long node_us = ustime() - start;
+
+            if (by_entry.visited != by_node.visited ||
+                by_entry.bytes != by_node.bytes)
+                ERR("Range by node visited %lu entries (%zu bytes), "
+                    "by entry %lu (%zu bytes)",
+                    by_node.visited, by_node.bytes, by_entry.visited,
+                    by_entry.bytes);
+            printf("\tby entry: %lld usec, by node: %lld usec\n", entry_us,
+                   node_us);
+            quicklistRelease(ql);
+        }
+    }
+
     TEST("bookmark get updated to next item") {
         quicklist *ql = quicklistNew(1, 0);
         quicklistPushTail(ql, "1", 1);
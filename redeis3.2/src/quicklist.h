@@ -131,6 +131,12 @@ typedef struct quicklistEntry {
     int offset;
 } quicklistEntry;
 
+/* Called by quicklistRangeByNode() once per node holding part of the range:
+ * 'zl' is the uncompressed ziplist of the node, 'p' the first entry of the
+ * range in it and 'count' the number of range entries starting at 'p'. */
+typedef void (quicklistRangeFn)(void *privdata, unsigned char *zl,
+                                unsigned char *p, unsigned long count);
+
 #define QUICKLIST_HEAD 0
 #define QUICKLIST_TAIL -1
 
@@ -176,6 +182,9 @@ quicklistIter *quicklistGetIterator(const quicklist *quicklist, int direction);
 quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
                                          int direction, const long long idx);
 int quicklistNext(quicklistIter *iter, quicklistEntry *node);
+unsigned long quicklistRangeByNode(quicklist *quicklist, const long long start,
+                                   unsigned long count, quicklistRangeFn *fn,
+                                   void *privdata);
 void quicklistReleaseIterator(quicklistIter *iter);
 quicklist *quicklistDup(quicklist *orig);
 int quicklistIndex(const quicklist *quicklist, const long long index,
@@ -926,6 +926,38 @@ void *raxFind(rax *rax, unsigned char *s, size_t len) {
     return raxGetData(h);
 }
 
+/* Call 'fn' for every key of the radix tree that is a prefix of the string
+ * 's' of 'len' bytes (including the empty key and 's' itself), from the
+ * shortest to the longest, passing the key length and the associated data.
+ * The tree is descended a single time along 's'. If 'fn' returns 0 the walk
+ * is stopped. */
+void raxWalkPrefixes(rax *rax, unsigned char *s, size_t len, int (*fn)(void *privdata, size_t keylen, void *data), void *privdata) {
+    raxNode *h = rax->head;
+    size_t i = 0; /* Position in the string. */
+    size_t j;     /* Child to follow. */
+
+    while(1) {
+        if (h->iskey && !fn(privdata,i,raxGetData(h))) return;
+        if (h->size == 0 || i == len) return;
+
+        unsigned char *v = h->data;
+        if (h->iscompr) {
+            /* Keys can only end at node boundaries. */
+            if (len-i < h->size || memcmp(v,s+i,h->size) != 0) return;
+            i += h->size;
+            j = 0;
+        } else {
+            for (j = 0; j < h->size; j++) {
+                if (v[j] == s[i]) break;
+            }
+            if (j == h->size) return;
+            i++;
+        }
+        raxNode **children = raxNodeFirstChildPtr(h);
+        memcpy(&h,children+j,sizeof(h));
+    }
+}
+
 /* Return the memory address where the 'parent' node stores the specified
  * 'child' pointer, so that the caller can update the pointer with another
  * one if needed. The function assumes it will find a match, otherwise the
@@ -1429,6 +1429,8 @@ redisDb *disklessLoadMakeBackups(void) {
         backups[i] = server.db[i];
         server.db[i].dict = dictCreate(&dbDictType,NULL);
         server.db[i].expires = dictCreate(&keyptrDictType,NULL);
+        /* The slot lists link the entries of the backup. */
+        if (backups[i].slots_to_keys) slotToKeyInit(&server.db[i]);
     }
     return backups;
 }
@@ -1451,6 +1453,7 @@ void disklessLoadRestoreBackups(redisDb *backup, int restore, int empty_db_flags
         for (int i=0; i<server.dbnum; i++) {
             dictRelease(server.db[i].dict);
             dictRelease(server.db[i].expires);
+            slotToKeyDestroy(&server.db[i]);
             server.db[i] = backup[i];
         }
     } else {
@@ -1459,6 +1462,7 @@ void disklessLoadRestoreBackups(redisDb *backup, int restore, int empty_db_flags
         for (int i=0; i<server.dbnum; i++) {
             dictRelease(backup[i].dict);
             dictRelease(backup[i].expires);
+            slotToKeyDestroy(&backup[i]);
         }
     }
     zfree(backup);
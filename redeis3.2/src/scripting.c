@@ -46,6 +46,9 @@ char *redisProtocolToLuaType_Aggregate(lua_State *lua, char *reply, int atype);
 char *redisProtocolToLuaType_Null(lua_State *lua, char *reply);
 char *redisProtocolToLuaType_Bool(lua_State *lua, char *reply, int tf);
 char *redisProtocolToLuaType_Double(lua_State *lua, char *reply);
+char *redisProtocolToLuaType_Verbatim(lua_State *lua, char *reply);
+char *redisProtocolToLuaType_BigNumber(lua_State *lua, char *reply);
+char *redisProtocolToLuaType_Attribute(lua_State *lua, char *reply);
 int redis_math_random (lua_State *L);
 int redis_math_randomseed (lua_State *L);
 void ldbInit(void);
@@ -130,6 +133,10 @@ void sha1hex(char *digest, char *script, size_t len) {
 char *redisProtocolToLuaType(lua_State *lua, char* reply) {
     char *p = reply;
 
+    /* Every call pushes a value, and aggregates a few more slots while
+     * recursing into their elements. */
+    if (!lua_checkstack(lua,5)) serverPanic("lua stack limit reach when parsing redis.call reply");
+
     switch(*p) {
     case ':': p = redisProtocolToLuaType_Int(lua,reply); break;
     case '$': p = redisProtocolToLuaType_Bulk(lua,reply); break;
@@ -141,6 +148,10 @@ char *redisProtocolToLuaType(lua_State *lua, char* reply) {
     case '_': p = redisProtocolToLuaType_Null(lua,reply); break;
     case '#': p = redisProtocolToLuaType_Bool(lua,reply,p[1]); break;
     case ',': p = redisProtocolToLuaType_Double(lua,reply); break;
+    case '=': p = redisProtocolToLuaType_Verbatim(lua,reply); break;
+    case '(': p = redisProtocolToLuaType_BigNumber(lua,reply); break;
+    case '>': p = redisProtocolToLuaType_Aggregate(lua,reply,*p); break;
+    case '|': p = redisProtocolToLuaType_Attribute(lua,reply); break;
     }
     return p;
 }
@@ -194,7 +205,7 @@ char *redisProtocolToLuaType_Aggregate(lua_State *lua, char *reply, int atype) {
     int j = 0;
 
     string2ll(reply+1,p-reply-1,&mbulklen);
-    if (server.lua_client->resp == 2 || atype == '*') {
+    if (server.lua_client->resp == 2 || atype == '*' || atype == '>') {
         p += 2;
         if (mbulklen == -1) {
             lua_pushboolean(lua,0);
@@ -262,6 +273,401 @@ char *redisProtocolToLuaType_Double(lua_State *lua, char *reply) {
     return p+2;
 }
 
+/* Verbatim strings are returned as plain strings, without the three chars
+ * format and the ":" separator, exactly like RESP2 clients receive them. */
+char *redisProtocolToLuaType_Verbatim(lua_State *lua, char *reply) {
+    char *p = strchr(reply+1,'\r');
+    long long len;
+
+    string2ll(reply+1,p-reply-1,&len);
+    if (len >= 4)
+        lua_pushlstring(lua,p+2+4,len-4);
+    else
+        lua_pushlstring(lua,p+2,len);
+    return p+2+len+2;
+}
+
+/* Big numbers are returned as strings, like RESP2 clients receive them. */
+char *redisProtocolToLuaType_BigNumber(lua_State *lua, char *reply) {
+    char *p = strchr(reply+1,'\r');
+
+    lua_pushlstring(lua,reply+1,p-reply-1);
+    return p+2;
+}
+
+/* Attributes are not replies: they are parsed and discarded, and the
+ * reply following them is converted instead. */
+char *redisProtocolToLuaType_Attribute(lua_State *lua, char *reply) {
+    char *p = strchr(reply+1,'\r');
+    long long len, j;
+
+    string2ll(reply+1,p-reply-1,&len);
+    p += 2;
+    for (j = 0; j < len*2; j++) {
+        p = redisProtocolToLuaType(lua,p);
+        lua_pop(lua,1);
+    }
+    return redisProtocolToLuaType(lua,p);
+}
+
+/* ---------------------------------------------------------------------------
+ * Direct conversion of command replies into Lua values.
+ *
+ * While redis.call() executes a command, the Lua client has the
+ * CLIENT_LUA_DIRECT_REPLY flag set, and the addReply*() functions, instead
+ * of accumulating the protocol in the client output buffers, call the
+ * functions below, that push the reply on the Lua stack directly: bulk
+ * strings, integers and aggregate headers never get serialized and parsed
+ * again. The Lua values are exactly the ones redisProtocolToLuaType()
+ * would create from the same reply.
+ *
+ * Protocol emitted as raw text (shared objects, addReplyProto() and so
+ * forth) is parsed incrementally by luaReplyProto(), buffering a partial
+ * element until the rest of it is emitted.
+ * ------------------------------------------------------------------------- */
+
+/* An aggregate reply being filled. The table, and for RESP3 maps and sets
+ * also the wrapping table with its "map" / "set" field name, are on the
+ * Lua stack. */
+typedef struct luaReplyLevel {
+    long count;     /* Elements expected, map keys and values counted
+                       separately. -1 if the length is deferred. */
+    long added;     /* Elements added so far. */
+    int type;       /* '*' for arrays, '%' / '~' for RESP3 maps / sets,
+                       '|' for attributes, 'D' for deferred length
+                       aggregates. */
+    int prefix;     /* Deferred aggregates: final type, once known. */
+} luaReplyLevel;
+
+static struct {
+    lua_State *lua;
+    luaReplyLevel *levels;  /* Stack of aggregates being filled. */
+    int depth;              /* Number of aggregates being filled. */
+    int size;               /* Allocated levels. */
+    int values;             /* Top level values pushed. */
+    int type;               /* Protocol type of the first top level value. */
+    sds pending;            /* Incomplete raw protocol. */
+} luaReply;
+
+/* Start converting the replies of a command into Lua values. */
+static void luaReplyBegin(lua_State *lua) {
+    luaReply.lua = lua;
+    luaReply.depth = 0;
+    luaReply.values = 0;
+    luaReply.type = 0;
+    if (luaReply.pending == NULL) luaReply.pending = sdsempty();
+    sdsclear(luaReply.pending);
+}
+
+/* Finish the conversion, returning the protocol type of the reply, as the
+ * first byte of its RESP representation would be, or 0 if the command did
+ * not reply. */
+static int luaReplyEnd(void) {
+    serverAssert(luaReply.depth == 0 && sdslen(luaReply.pending) == 0);
+    return luaReply.type;
+}
+
+int luaReplyIsPending(void) {
+    return sdslen(luaReply.pending) != 0;
+}
+
+/* Remember the type of the first top level reply. Called before pushing
+ * every value, it also makes sure the Lua stack has room for it: open
+ * aggregates keep up to four slots each on the stack, so the space checked
+ * when the innermost one was opened may already be in use. */
+static void luaReplyMarkType(int type) {
+    if (luaReply.depth == 0 && luaReply.values == 0) luaReply.type = type;
+    if (!lua_checkstack(luaReply.lua,5))
+        serverPanic("lua stack limit reach when converting redis.call reply");
+}
+
+/* Convert the deferred aggregate on top of the stack into the Lua
+ * representation of a RESP3 map or set. */
+static void luaReplyConvertDeferred(int prefix, long added) {
+    lua_State *lua = luaReply.lua;
+    long j;
+
+    if (!lua_checkstack(lua,5))
+        serverPanic("lua stack limit reach when converting redis.call reply");
+    lua_newtable(lua);
+    lua_pushstring(lua,prefix == '%' ? "map" : "set");
+    lua_newtable(lua);
+    for (j = 1; j <= added; j++) {
+        lua_rawgeti(lua,-4,j);
+        if (prefix == '%') {
+            lua_rawgeti(lua,-5,++j);
+        } else {
+            lua_pushboolean(lua,1);
+        }
+        lua_settable(lua,-3);
+    }
+    lua_settable(lua,-3);
+    lua_remove(lua,-2);
+}
+
+/* The aggregate on top of the stack is complete: remove it from the stack
+ * of aggregates, leaving its Lua value on top of the Lua stack. Attributes
+ * are not values: they are discarded, and 0 is returned, while 1 is
+ * returned if the caller should emit the value. */
+static int luaReplyCloseLevel(void) {
+    luaReplyLevel *l = luaReply.levels+luaReply.depth-1;
+    int emit = 1;
+
+    if (l->type == '%' || l->type == '~') {
+        lua_settable(luaReply.lua,-3);
+    } else if (l->type == '|' || (l->type == 'D' && l->prefix == '|')) {
+        lua_pop(luaReply.lua,1);
+        emit = 0;
+    } else if (l->type == 'D' &&
+               (l->prefix == '%' || l->prefix == '~') &&
+               server.lua_client->resp == 3)
+    {
+        luaReplyConvertDeferred(l->prefix,l->added);
+    }
+    luaReply.depth--;
+    return emit;
+}
+
+/* Add the value on top of the Lua stack to the aggregate being filled,
+ * closing all the aggregates it completes. */
+static void luaReplyEmit(void) {
+    lua_State *lua = luaReply.lua;
+
+    while(1) {
+        if (luaReply.depth == 0) {
+            /* Only the first reply of the command is returned. */
+            if (luaReply.values++) lua_pop(lua,1);
+            return;
+        }
+
+        luaReplyLevel *l = luaReply.levels+luaReply.depth-1;
+        if (l->type == '%') {
+            /* Keys stay on the stack until the value is added. */
+            if (l->added % 2) lua_settable(lua,-3);
+        } else if (l->type == '~') {
+            lua_pushboolean(lua,1);
+            lua_settable(lua,-3);
+        } else {
+            lua_rawseti(lua,-2,l->added+1);
+        }
+        if (++l->added != l->count) return;
+        if (!luaReplyCloseLevel()) return;
+    }
+}
+
+void luaReplyString(const char *s, size_t len) {
+    luaReplyMarkType('$');
+    lua_pushlstring(luaReply.lua,s,len);
+    luaReplyEmit();
+}
+
+void luaReplyLongLong(long long ll) {
+    luaReplyMarkType(':');
+    lua_pushnumber(luaReply.lua,(lua_Number)ll);
+    luaReplyEmit();
+}
+
+/* Status and error replies are tables with an "ok" or "err" field. Like in
+ * addReplyErrorLength(), an error not starting with "-" gets the generic
+ * "ERR" error code. */
+void luaReplyStatus(const char *s, size_t len, int type) {
+    lua_State *lua = luaReply.lua;
+
+    luaReplyMarkType(type);
+    lua_newtable(lua);
+    if (type == '-') {
+        lua_pushstring(lua,"err");
+        if (len && s[0] == '-') {
+            lua_pushlstring(lua,s+1,len-1);
+        } else {
+            lua_pushstring(lua,"ERR ");
+            lua_pushlstring(lua,s,len);
+            lua_concat(lua,2);
+        }
+    } else {
+        lua_pushstring(lua,"ok");
+        lua_pushlstring(lua,s,len);
+    }
+    lua_settable(lua,-3);
+    luaReplyEmit();
+}
+
+static luaReplyLevel *luaReplyOpenLevel(long count, int type) {
+    if (luaReply.depth == luaReply.size) {
+        luaReply.size = luaReply.size ? luaReply.size*2 : 8;
+        luaReply.levels = zrealloc(luaReply.levels,
+                                   sizeof(luaReplyLevel)*luaReply.size);
+    }
+    luaReplyLevel *l = luaReply.levels+luaReply.depth++;
+    l->count = count;
+    l->added = 0;
+    l->type = type;
+    l->prefix = 0;
+    return l;
+}
+
+/* Start an aggregate of 'length' elements: '*' arrays, '>' pushes, '%' maps,
+ * '~' sets and '|' attributes. Like in redisProtocolToLuaType_Aggregate()
+ * pushes are arrays, and so are maps and sets unless the script selected
+ * RESP3. Attributes are collected and then discarded. */
+void luaReplyAggregateLen(long length, int prefix) {
+    lua_State *lua = luaReply.lua;
+    int type = '*';
+
+    if (length == -1) {
+        /* RESP2 null array. */
+        luaReplyMarkType('$');
+        lua_pushboolean(lua,0);
+        luaReplyEmit();
+        return;
+    }
+    if (prefix == '|') {
+        /* Not a reply: the type is the one of the reply that follows. */
+        type = prefix;
+        length *= 2;
+        if (!lua_checkstack(lua,5))
+            serverPanic("lua stack limit reach when converting redis.call reply");
+    } else {
+        luaReplyMarkType(prefix);
+    }
+    if (server.lua_client->resp == 3 && (prefix == '%' || prefix == '~')) {
+        type = prefix;
+        if (prefix == '%') length *= 2;
+        lua_newtable(lua);
+        lua_pushstring(lua,prefix == '%' ? "map" : "set");
+    }
+    lua_newtable(lua);
+    luaReplyOpenLevel(length,type);
+    if (length == 0 && luaReplyCloseLevel()) luaReplyEmit();
+}
+
+/* Start an aggregate whose length and type are not known yet. The elements
+ * are collected as an array, converted if needed when the length is set.
+ * The returned token identifies the aggregate in luaReplySetDeferredLen(). */
+void *luaReplyDeferredLen(void) {
+    serverAssert(sdslen(luaReply.pending) == 0);
+    luaReplyMarkType('*');
+    lua_newtable(luaReply.lua);
+    luaReplyOpenLevel(-1,'D');
+    return (void*)(intptr_t)luaReply.depth;
+}
+
+void luaReplySetDeferredLen(void *token, long length, int prefix) {
+    int level = (intptr_t)token;
+    luaReplyLevel *l = luaReply.levels+level-1;
+
+    serverAssert(level <= luaReply.depth && l->type == 'D' && l->count == -1);
+    if (level == 1 && luaReply.values == 0 && prefix != '|')
+        luaReply.type = prefix;
+    if ((prefix == '%' && server.lua_client->resp == 3) || prefix == '|')
+        length *= 2;
+    l->prefix = prefix;
+    l->count = length;
+    if (level == luaReply.depth && l->added == l->count &&
+        luaReplyCloseLevel()) luaReplyEmit();
+}
+
+/* Parse the complete elements at the start of the protocol 's', returning
+ * the number of bytes consumed. */
+static size_t luaReplyParse(const char *s, size_t len) {
+    lua_State *lua = luaReply.lua;
+    const char *p = s, *end = s+len;
+
+    while(p < end) {
+        const char *cr = memchr(p,'\r',end-p);
+        long long ll = 0;
+
+        if (cr == NULL || cr+1 >= end) break;
+        switch(*p) {
+        case '$':
+        case '=':
+            string2ll(p+1,cr-p-1,&ll);
+            if (ll == -1) {
+                luaReplyMarkType('$');
+                lua_pushboolean(lua,0);
+                luaReplyEmit();
+                break;
+            }
+            if (cr+2+ll+2 > end) return p-s;
+            /* Verbatim strings start with their three chars format. */
+            if (*p == '=' && ll >= 4)
+                luaReplyString(cr+2+4,ll-4);
+            else
+                luaReplyString(cr+2,ll);
+            cr += ll+2;
+            break;
+        case '*': case '%': case '~': case '>': case '|':
+            string2ll(p+1,cr-p-1,&ll);
+            luaReplyAggregateLen(ll,*p);
+            break;
+        case ':':
+            string2ll(p+1,cr-p-1,&ll);
+            luaReplyLongLong(ll);
+            break;
+        case '+':
+        case '-':
+            luaReplyStatus(*p == '-' ? p : p+1,*p == '-' ? cr-p : cr-p-1,*p);
+            break;
+        case '_':
+            luaReplyMarkType('_');
+            lua_pushnil(lua);
+            luaReplyEmit();
+            break;
+        case '#':
+            luaReplyMarkType('#');
+            lua_pushboolean(lua,p[1] == 't');
+            luaReplyEmit();
+            break;
+        case ',': {
+            char buf[MAX_LONG_DOUBLE_CHARS+1];
+            size_t dlen = cr-p-1;
+            double d = 0;
+
+            if (dlen <= MAX_LONG_DOUBLE_CHARS) {
+                memcpy(buf,p+1,dlen);
+                buf[dlen] = '\0';
+                d = strtod(buf,NULL);
+            }
+            luaReplyMarkType(',');
+            lua_newtable(lua);
+            lua_pushstring(lua,"double");
+            lua_pushnumber(lua,d);
+            lua_settable(lua,-3);
+            luaReplyEmit();
+            break;
+        }
+        case '(':
+            /* Big numbers are returned as strings. */
+            luaReplyString(p+1,cr-p-1);
+            break;
+        default:
+            serverPanic("Unknown reply type '%c' converting redis.call reply",
+                        *p);
+            break;
+        }
+        p = cr+2;
+    }
+    return p-s;
+}
+
+/* Convert the raw protocol 's' into Lua values. Elements split across
+ * calls, like the ":" "<number>" "\r\n" parts of an integer reply emitted
+ * one at a time, are buffered until complete. */
+void luaReplyProto(const char *s, size_t len) {
+    size_t consumed;
+
+    if (sdslen(luaReply.pending)) {
+        luaReply.pending = sdscatlen(luaReply.pending,s,len);
+        consumed = luaReplyParse(luaReply.pending,sdslen(luaReply.pending));
+        sdsrange(luaReply.pending,consumed,-1);
+    } else {
+        consumed = luaReplyParse(s,len);
+        if (consumed < len)
+            luaReply.pending = sdscatlen(luaReply.pending,s+consumed,
+                                         len-consumed);
+    }
+}
+
 /* This function is used in order to push an error on the Lua stack in the
  * format used by redis.pcall to return errors, which is a lua table
  * with a single "err" field set to the error string. Note that this
@@ -341,6 +747,14 @@ void luaSortArray(lua_State *lua) {
 void luaReplyToRedisReply(client *c, lua_State *lua) {
     int t = lua_type(lua,-1);
 
+    if (!lua_checkstack(lua,4)) {
+        /* Increase the Lua stack if needed to make sure there is enough room
+         * to push 4 elements to the stack. On failure, return error. */
+        addReplyErrorFormat(c,"reached lua stack limit");
+        lua_pop(lua,1); /* pop the element from the stack */
+        return;
+    }
+
     switch(t) {
     case LUA_TSTRING:
         addReplyBulkCBuffer(c,(char*)lua_tostring(lua,-1),lua_strlen(lua,-1));
@@ -723,6 +1137,27 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
         if (server.lua_repl & PROPAGATE_REPL)
             call_flags |= CMD_CALL_PROPAGATE_REPL;
     }
+    /* Unless the debugger needs to log the reply protocol, the reply is
+     * converted into a Lua value while the command emits it. */
+    if (!(ldb.active && ldb.step)) {
+        int type;
+
+        luaReplyBegin(lua);
+        c->flags |= CLIENT_LUA_DIRECT_REPLY;
+        call(c,call_flags);
+        c->flags &= ~CLIENT_LUA_DIRECT_REPLY;
+        type = luaReplyEnd();
+
+        if (raise_error && type != '-') raise_error = 0;
+        /* Sort the output array if needed, assuming it is a non-null multi
+         * bulk reply as expected. */
+        if ((cmd->flags & CMD_SORT_FOR_SCRIPT) &&
+            (server.lua_replicate_commands == 0) && type == '*')
+        {
+            luaSortArray(lua);
+        }
+        goto cleanup;
+    }
     call(c,call_flags);
 
     /* Convert the result of the Redis command into a suitable Lua type.
@@ -786,10 +1221,15 @@ cleanup:
         }
     }
 
+    /* Commands like INCRBYFLOAT rewrite their arguments, reallocating the
+     * vector to c->argc entries. If the allocation was shrunk in place the
+     * pointer is unchanged, but the vector no longer has argv_size slots. */
     if (c->argv != argv) {
         zfree(c->argv);
         argv = NULL;
         argv_size = 0;
+    } else if (c->argc != argc) {
+        argv_size = c->argc;
     }
 
     c->user = NULL;
@@ -1338,6 +1778,30 @@ int redis_math_randomseed (lua_State *L) {
  * EVAL and SCRIPT commands implementation
  * ------------------------------------------------------------------------- */
 
+/* Add the script to the scripts cache, without compiling it: this is
+ * enough for EVALSHA to find it, and the script is compiled the first time
+ * it is called. Used for the scripts that were already validated by
+ * luaCreateFunction(), when loading them from the RDB file or receiving
+ * them from our master, so that thousands of scripts don't have to be
+ * compiled at startup or after a failover before any of them is needed.
+ *
+ * Returns the SHA1 of the script, valid until the next scriptingReset(). */
+sds luaRegisterScript(robj *body) {
+    char sha1[41];
+    dictEntry *de;
+
+    sha1hex(sha1,body->ptr,sdslen(body->ptr));
+    sds sha = sdsnewlen(sha1,40);
+    if ((de = dictFind(server.lua_scripts,sha)) != NULL) {
+        sdsfree(sha);
+        return dictGetKey(de);
+    }
+    dictAdd(server.lua_scripts,sha,body);
+    server.lua_scripts_mem += sdsZmallocSize(sha) + getStringObjectSdsUsedMemory(body);
+    incrRefCount(body);
+    return sha;
+}
+
 /* Define a Lua function with the specified body.
  * The function name will be generated in the following form:
  *
@@ -1351,7 +1815,8 @@ int redis_math_randomseed (lua_State *L) {
  * to scriptingReset() function), otherwise NULL is returned.
  *
  * The function handles the fact of being called with a script that already
- * exists, and in such a case, it behaves like in the success case.
+ * exists, and in such a case, it behaves like in the success case. Scripts
+ * registered by luaRegisterScript() and not yet compiled are compiled.
  *
  * If 'c' is not NULL, on error the client is informed with an appropriate
  * error describing the nature of the problem and the Lua interpreter error. */
@@ -1365,10 +1830,18 @@ sds luaCreateFunction(client *c, lua_State *lua, robj *body) {
 
     sds sha = sdsnewlen(funcname+2,40);
     if ((de = dictFind(server.lua_scripts,sha)) != NULL) {
-        sdsfree(sha);
-        return dictGetKey(de);
+        int compiled;
+
+        lua_getglobal(lua,funcname);
+        compiled = !lua_isnil(lua,-1);
+        lua_pop(lua,1);
+        if (compiled) {
+            sdsfree(sha);
+            return dictGetKey(de);
+        }
     }
 
+    long long start = ustime();
     sds funcdef = sdsempty();
     funcdef = sdscat(funcdef,"function ");
     funcdef = sdscatlen(funcdef,funcname,42);
@@ -1398,6 +1871,14 @@ sds luaCreateFunction(client *c, lua_State *lua, robj *body) {
         sdsfree(sha);
         return NULL;
     }
+    server.stat_lua_compilations++;
+    server.stat_lua_compile_usec += ustime()-start;
+
+    /* Compiling a script that was already in the cache. */
+    if (de) {
+        sdsfree(sha);
+        return dictGetKey(de);
+    }
 
     /* We also save a SHA1 -> Original script map in a dictionary
      * so that we can replicate / write in the AOF all the
@@ -1519,16 +2000,25 @@ void evalGenericCommand(client *c, int evalsha) {
     /* Try to lookup the Lua function */
     lua_getglobal(lua, funcname);
     if (lua_isnil(lua,-1)) {
+        robj *body = c->argv[1];
+
         lua_pop(lua,1); /* remove the nil from the stack */
         /* Function not defined... let's define it if we have the
-         * body of the function. If this is an EVALSHA call we can just
-         * return an error. */
+         * body of the function. If this is an EVALSHA call the body may
+         * be in the scripts cache, registered but not compiled yet,
+         * otherwise we can just return an error. */
         if (evalsha) {
-            lua_pop(lua,1); /* remove the error handler from the stack. */
-            addReply(c, shared.noscripterr);
-            return;
+            sds sha = sdsnewlen(funcname+2,40);
+            body = dictFetchValue(server.lua_scripts,sha);
+            sdsfree(sha);
+            if (body == NULL) {
+                lua_pop(lua,1); /* remove the error handler from the stack. */
+                addReply(c, shared.noscripterr);
+                return;
+            }
         }
-        if (luaCreateFunction(c,lua,c->argv[1]) == NULL) {
+        server.stat_lua_cache_misses++;
+        if (luaCreateFunction(c,lua,body) == NULL) {
             lua_pop(lua,1); /* remove the error handler from the stack. */
             /* The error is sent to the client by luaCreateFunction()
              * itself when it returns NULL. */
@@ -1537,6 +2027,8 @@ void evalGenericCommand(client *c, int evalsha) {
         /* Now the following is guaranteed to return non nil */
         lua_getglobal(lua, funcname);
         serverAssert(!lua_isnil(lua,-1));
+    } else {
+        server.stat_lua_cache_hits++;
     }
 
     /* Populate the argv and keys table accordingly to the arguments that
@@ -1713,7 +2205,13 @@ NULL
                 addReply(c,shared.czero);
         }
     } else if (c->argc == 3 && !strcasecmp(c->argv[1]->ptr,"load")) {
-        sds sha = luaCreateFunction(c,server.lua,c->argv[2]);
+        sds sha;
+        /* Scripts propagated by our master were already validated there:
+         * just cache them, they are compiled on their first call. */
+        if (c->flags & CLIENT_MASTER)
+            sha = luaRegisterScript(c->argv[2]);
+        else
+            sha = luaCreateFunction(c,server.lua,c->argv[2]);
         if (sha == NULL) return; /* The error was sent by luaCreateFunction(). */
         addReplyBulkCBuffer(c,sha,40);
         forceCommandPropagation(c,PROPAGATE_REPL|PROPAGATE_AOF);
@@ -2233,11 +2731,15 @@ char *ldbRedisProtocolToHuman(sds *o, char *reply) {
     switch(*p) {
     case ':': p = ldbRedisProtocolToHuman_Int(o,reply); break;
     case '$': p = ldbRedisProtocolToHuman_Bulk(o,reply); break;
+    case '=': p = ldbRedisProtocolToHuman_Bulk(o,reply); break;
     case '+': p = ldbRedisProtocolToHuman_Status(o,reply); break;
     case '-': p = ldbRedisProtocolToHuman_Status(o,reply); break;
+    case '(': p = ldbRedisProtocolToHuman_Int(o,reply); break;
     case '*': p = ldbRedisProtocolToHuman_MultiBulk(o,reply); break;
+    case '>': p = ldbRedisProtocolToHuman_MultiBulk(o,reply); break;
     case '~': p = ldbRedisProtocolToHuman_Set(o,reply); break;
     case '%': p = ldbRedisProtocolToHuman_Map(o,reply); break;
+    case '|': p = ldbRedisProtocolToHuman_Map(o,reply); break;
     case '_': p = ldbRedisProtocolToHuman_Null(o,reply); break;
     case '#': p = ldbRedisProtocolToHuman_Bool(o,reply); break;
     case ',': p = ldbRedisProtocolToHuman_Double(o,reply); break;
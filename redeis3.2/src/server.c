@@ -827,6 +827,10 @@ struct redisCommand redisCommandTable[] = {
      "write random @keyspace @dangerous",
      0,migrateGetKeys,0,0,0,0,0,0},
 
+    {"asyncmigrate",asyncMigrateCommand,-2,
+     "admin no-script random @keyspace @dangerous",
+     0,NULL,0,0,0,0,0,0},
+
     {"asking",askingCommand,1,
      "fast @keyspace",
      0,NULL,0,0,0,0,0,0},
@@ -1331,7 +1335,8 @@ dictType dbDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictObjectDestructor   /* val destructor */
+    dictObjectDestructor,       /* val destructor */
+    dbDictEntryMetadataSize     /* size of entry metadata in bytes */
 };
 
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
@@ -1354,6 +1359,17 @@ dictType keyptrDictType = {
     NULL                        /* val destructor */
 };
 
+/* Buckets of server.pubsub_patterns_index. Pattern objects -> list of
+ * subscribed clients: both are owned by server.pubsub_patterns_dict. */
+dictType pubsubPatternIndexDictType = {
+    dictObjHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictObjKeyCompare,          /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
 /* Command table. sds string -> command struct pointer. */
 dictType commandTableDictType = {
     dictSdsCaseHash,            /* hash function */
@@ -1364,7 +1380,7 @@ dictType commandTableDictType = {
     NULL                        /* val destructor */
 };
 
-/* Hash type hash table (note that small hashes are represented with ziplists) */
+/* Hash type hash table (note that small hashes are represented with listpacks) */
 dictType hashDictType = {
     dictSdsHash,                /* hash function */
     NULL,                       /* key dup */
@@ -1959,6 +1975,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
                 stat_net_input_bytes);
         trackInstantaneousMetric(STATS_METRIC_NET_OUTPUT,
                 stat_net_output_bytes);
+        trackInstantaneousMetric(STATS_METRIC_DEFRAG_BYTES,
+                server.stat_active_defrag_bytes);
     }
 
     /* We have just LRU_BITS bits per object for LRU information.
@@ -2114,6 +2132,9 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
         migrateCloseTimedoutSockets();
     }
 
+    /* Fail the ASYNCMIGRATE job if the target stopped answering. */
+    asyncMigrateCron();
+
     /* Stop the I/O threads if we don't have enough pending work. */
     stopThreadedIOIfNeeded();
 
@@ -2210,6 +2231,7 @@ void whileBlockedCron() {
 }
 
 extern int ProcessingEventsWhileBlocked;
+static int gil_released_before_sleep = 0; /* See beforeSleep()/afterSleep(). */
 
 /* This function gets called every time Redis is entering the
  * main loop of the event driven library, that is, before to sleep
@@ -2310,15 +2332,20 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     /* Close clients that need to be closed asynchronous */
     freeClientsInAsyncFreeQueue();
 
-    /* Before we are going to sleep, let the threads access the dataset by
-     * releasing the GIL. Redis main thread will not touch anything at this
-     * time. */
-    if (moduleCount()) moduleReleaseGIL();
-
     /* Try to process blocked clients every once in while. Example: A module
      * calls RM_SignalKeyAsReady from within a timer callback (So we don't
      * visit processCommand() at all). */
     handleClientsBlockedOnKeys();
+
+    /* Before we are going to sleep, let the threads access the dataset by
+     * releasing the GIL. Redis main thread will not touch anything at this
+     * time. The GIL is also used by the active defrag scan thread. Since
+     * active-defrag-threaded can be changed at runtime, remember if the GIL
+     * was released so that afterSleep() re-acquires it only in that case. */
+    if (moduleCount() || server.active_defrag_threaded) {
+        moduleReleaseGIL();
+        gil_released_before_sleep = 1;
+    }
 }
 
 /* This function is called immediately after the event loop multiplexing
@@ -2327,8 +2354,9 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
 void afterSleep(struct aeEventLoop *eventLoop) {
     UNUSED(eventLoop);
 
-    if (!ProcessingEventsWhileBlocked) {
-        if (moduleCount()) moduleAcquireGIL();
+    if (!ProcessingEventsWhileBlocked && gil_released_before_sleep) {
+        moduleAcquireGIL();
+        gil_released_before_sleep = 0;
     }
 }
 
@@ -2902,7 +2930,9 @@ void resetServerStats(void) {
     server.stat_active_defrag_misses = 0;
     server.stat_active_defrag_key_hits = 0;
     server.stat_active_defrag_key_misses = 0;
+    server.stat_active_defrag_candidates = 0;
     server.stat_active_defrag_scanned = 0;
+    server.stat_active_defrag_bytes = 0;
     server.stat_fork_time = 0;
     server.stat_fork_rate = 0;
     server.stat_rejected_conn = 0;
@@ -2913,6 +2943,11 @@ void resetServerStats(void) {
     atomicSet(server.stat_total_reads_processed, 0);
     server.stat_io_writes_processed = 0;
     atomicSet(server.stat_total_writes_processed, 0);
+    server.stat_lua_compilations = 0;
+    server.stat_lua_compile_usec = 0;
+    server.stat_lua_cache_hits = 0;
+    server.stat_lua_cache_misses = 0;
+    server.stat_async_migrate_keys = 0;
     for (j = 0; j < STATS_METRIC_COUNT; j++) {
         server.inst_metric[j].idx = 0;
         server.inst_metric[j].last_sample_time = mstime();
@@ -3026,6 +3061,7 @@ void initServer(void) {
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&objectKeyPointerValueDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
+        server.db[j].slots_to_keys = NULL; /* Set by clusterInit() later. */
         server.db[j].id = j;
         server.db[j].avg_ttl = 0;
         server.db[j].defrag_later = listCreate();
@@ -3035,6 +3071,7 @@ void initServer(void) {
     server.pubsub_channels = dictCreate(&keylistDictType,NULL);
     server.pubsub_patterns = listCreate();
     server.pubsub_patterns_dict = dictCreate(&keylistDictType,NULL);
+    server.pubsub_patterns_index = raxNew();
     listSetFreeMethod(server.pubsub_patterns,freePubsubPattern);
     listSetMatchMethod(server.pubsub_patterns,listMatchPubsubPattern);
     server.cronloops = 0;
@@ -4596,6 +4633,10 @@ sds genRedisInfoString(const char *section) {
             "active_defrag_misses:%lld\r\n"
             "active_defrag_key_hits:%lld\r\n"
             "active_defrag_key_misses:%lld\r\n"
+            "active_defrag_bytes:%lld\r\n"
+            "instantaneous_defrag_kbps:%.2f\r\n"
+            "active_defrag_pending_keys:%lu\r\n"
+            "active_defrag_candidates:%lld\r\n"
             "tracking_total_keys:%lld\r\n"
             "tracking_total_items:%lld\r\n"
             "tracking_total_prefixes:%lld\r\n"
@@ -4603,7 +4644,12 @@ sds genRedisInfoString(const char *section) {
             "total_reads_processed:%lld\r\n"
             "total_writes_processed:%lld\r\n"
             "io_threaded_reads_processed:%lld\r\n"
-            "io_threaded_writes_processed:%lld\r\n",
+            "io_threaded_writes_processed:%lld\r\n"
+            "lua_script_compilations:%lld\r\n"
+            "lua_script_compile_usec:%lld\r\n"
+            "lua_script_cache_hits:%lld\r\n"
+            "lua_script_cache_misses:%lld\r\n"
+            "async_migrate_keys:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
@@ -4631,6 +4677,10 @@ sds genRedisInfoString(const char *section) {
             server.stat_active_defrag_misses,
             server.stat_active_defrag_key_hits,
             server.stat_active_defrag_key_misses,
+            server.stat_active_defrag_bytes,
+            (float)getInstantaneousMetric(STATS_METRIC_DEFRAG_BYTES)/1024,
+            activeDefragPendingCandidates(),
+            server.stat_active_defrag_candidates,
             (unsigned long long) trackingGetTotalKeys(),
             (unsigned long long) trackingGetTotalItems(),
             (unsigned long long) trackingGetTotalPrefixes(),
@@ -4638,7 +4688,12 @@ sds genRedisInfoString(const char *section) {
             stat_total_reads_processed,
             stat_total_writes_processed,
             server.stat_io_reads_processed,
-            server.stat_io_writes_processed);
+            server.stat_io_writes_processed,
+            server.stat_lua_compilations,
+            server.stat_lua_compile_usec,
+            server.stat_lua_cache_hits,
+            server.stat_lua_cache_misses,
+            server.stat_async_migrate_keys);
     }
 
     /* Replication */
@@ -5282,6 +5337,8 @@ int main(int argc, char **argv) {
     if (argc == 3 && !strcasecmp(argv[1], "test")) {
         if (!strcasecmp(argv[2], "ziplist")) {
             return ziplistTest(argc, argv);
+        } else if (!strcasecmp(argv[2], "listpack")) {
+            return listpackTest(argc, argv);
         } else if (!strcasecmp(argv[2], "quicklist")) {
             quicklistTest(argc, argv);
         } else if (!strcasecmp(argv[2], "intset")) {
@@ -65,6 +65,7 @@ typedef long long ustime_t; /* microsecond time type. */
 #include "zmalloc.h"    /* total memory usage aware version of malloc/free */
 #include "anet.h"       /* Networking the easy way */
 #include "ziplist.h"    /* Compact list data structure */
+#include "listpack.h"   /* Compact list of strings, used by small hashes/zsets */
 #include "intset.h"     /* Compact integer set structure */
 #include "version.h"    /* Version macro */
 #include "util.h"       /* Misc functions useful in many places */
@@ -132,7 +133,8 @@ typedef long long ustime_t; /* microsecond time type. */
 #define STATS_METRIC_COMMAND 0    /* Number of commands executed. */
 #define STATS_METRIC_NET_INPUT 1  /* Bytes read to network .*/
 #define STATS_METRIC_NET_OUTPUT 2 /* Bytes written to network. */
-#define STATS_METRIC_COUNT 3
+#define STATS_METRIC_DEFRAG_BYTES 3 /* Bytes moved by active defrag. */
+#define STATS_METRIC_COUNT 4
 
 /* Protocol and I/O related defines */
 #define PROTO_MAX_QUERYBUF_LEN (1024 * 1024 * 1024) /* 1GB max query buffer. */
@@ -145,6 +147,10 @@ typedef long long ustime_t; /* microsecond time type. */
 
 #define LIMIT_PENDING_QUERYBUF (4 * 1024 * 1024) /* 4mb */
 
+/* Messages published to channels (or patterns) with at least this number of
+ * subscribers are copied to the clients by the I/O threads, when enabled. */
+#define PUBSUB_THREADED_FANOUT_MIN_CLIENTS 1000
+
 /* When configuring the server eventloop, we setup it so that the total number
  * of file descriptors we can handle are server.maxclients + RESERVED_FDS +
  * a few more to stay safe. Since RESERVED_FDS defaults to 32, we add 96
@@ -267,6 +273,9 @@ extern int configOOMScoreAdjValuesDefaults[CONFIG_OOM_COUNT];
 #define CLIENT_PROTOCOL_ERROR (1ULL << 39)        /* Protocol error chatting with it. */
 #define CLIENT_CLOSE_AFTER_COMMAND (1ULL << 40)   /* Close after executing commands \
                                                    * and writing entire reply. */
+#define CLIENT_LUA_DIRECT_REPLY (1ULL << 41)      /* Lua client: replies are \
+                                                   * converted to Lua values as \
+                                                   * they are emitted. */
 
 /* Client block type (btype field in client structure)
  * if CLIENT_BLOCKED flag is set. */
@@ -622,6 +631,7 @@ typedef struct RedisModuleDigest
 #define OBJ_ENCODING_EMBSTR 8     /* Embedded sds string encoding */
 #define OBJ_ENCODING_QUICKLIST 9  /* Encoded as linked list of ziplists */
 #define OBJ_ENCODING_STREAM 10    /* Encoded as a radix tree of listpacks */
+#define OBJ_ENCODING_LISTPACK 11  /* Encoded as a listpack */
 
 #define LRU_BITS 24
 #define LRU_CLOCK_MAX ((1 << LRU_BITS) - 1) /* Max value of obj->lru */
@@ -681,6 +691,8 @@ typedef struct clientReplyBlock
 /* Redis database representation. There are multiple databases identified
  * by integers from 0 (the default database) up to the max configured
  * database. The database number is the 'id' field in the structure. */
+typedef struct clusterSlotToKeyMapping clusterSlotToKeyMapping;
+
 typedef struct redisDb
 {
 
@@ -693,6 +705,8 @@ typedef struct redisDb
     dict *blocking_keys;          /* Keys with clients waiting for data (BLPOP)*/
     dict *ready_keys;             /* Blocked keys that received a PUSH */
     dict *watched_keys;           /* WATCHED keys for MULTI/EXEC CAS */
+    clusterSlotToKeyMapping *slots_to_keys; /* Keys of every slot. Only used in
+                                               cluster mode (db 0). */
     int id;                       /* Database ID */
     long long avg_ttl;            /* Average TTL, just for stats */
     unsigned long expires_cursor; /* Cursor of the active expire cycle. */
@@ -1352,7 +1366,9 @@ struct redisServer
     long long stat_active_defrag_misses;                  /* number of allocations scanned but not moved */
     long long stat_active_defrag_key_hits;                /* number of keys with moved allocations */
     long long stat_active_defrag_key_misses;              /* number of keys scanned and not moved */
+    long long stat_active_defrag_candidates;              /* number of keys queued by the defrag scan thread */
     long long stat_active_defrag_scanned;                 /* number of dictEntries scanned */
+    long long stat_active_defrag_bytes;                   /* number of bytes moved */
     size_t stat_peak_memory;                              /* Max used memory record */
     long long stat_fork_time;                             /* Time needed to perform latest fork() */
     double stat_fork_rate;                                /* Fork rate in GB/sec. */
@@ -1374,6 +1390,11 @@ struct redisServer
     long long stat_unexpected_error_replies;              /* Number of unexpected (aof-loading, replica to master, etc.) error replies */
     long long stat_io_reads_processed;                    /* Number of read events processed by IO / Main threads */
     long long stat_io_writes_processed;                   /* Number of write events processed by IO / Main threads */
+    long long stat_lua_compilations;  /* Number of Lua scripts compiled. */
+    long long stat_lua_compile_usec;  /* Time spent compiling Lua scripts. */
+    long long stat_lua_cache_hits;    /* EVAL/EVALSHA of compiled scripts. */
+    long long stat_lua_cache_misses;  /* EVAL/EVALSHA needing a compilation. */
+    long long stat_async_migrate_keys; /* Keys moved by ASYNCMIGRATE. */
     redisAtomic long long stat_total_reads_processed;     /* Total number of read events processed */
     redisAtomic long long stat_total_writes_processed;    /* Total number of write events processed */
     /* The following two are used to track instantaneous metrics, like
@@ -1392,6 +1413,7 @@ struct redisServer
     int active_expire_enabled; /* Can be disabled for testing purposes. */
     int active_expire_effort;  /* From 1 (default) to 10, active effort. */
     int active_defrag_enabled;
+    int active_defrag_threaded;                  /* Scan for defrag candidates in a helper thread */
     int jemalloc_bg_thread;                      /* Enable jemalloc background thread */
     size_t active_defrag_ignore_bytes;           /* minimum amount of fragmentation waste to start active defrag */
     int active_defrag_threshold_lower;           /* minimum percentage of fragmentation to start active defrag */
@@ -1593,11 +1615,11 @@ struct redisServer
     int sort_bypattern;
     int sort_store;
     /* Zip structure config, see redis.conf for more information  */
-    size_t hash_max_ziplist_entries;
-    size_t hash_max_ziplist_value;
+    size_t hash_max_listpack_entries;
+    size_t hash_max_listpack_value;
     size_t set_max_intset_entries;
-    size_t zset_max_ziplist_entries;
-    size_t zset_max_ziplist_value;
+    size_t zset_max_listpack_entries;
+    size_t zset_max_listpack_value;
     size_t hll_sparse_max_bytes;
     size_t stream_node_max_bytes;
     long long stream_node_max_entries;
@@ -1615,6 +1637,8 @@ struct redisServer
     dict *pubsub_channels;      /* Map channels to list of subscribed clients */
     list *pubsub_patterns;      /* A list of pubsub_patterns */
     dict *pubsub_patterns_dict; /* A dict of pubsub_patterns */
+    rax *pubsub_patterns_index; /* Patterns grouped by literal prefix, see
+                                   pubsubIndexPattern(). */
     int notify_keyspace_events; /* Events to propagate via Pub/Sub. This is an
                                    xor of NOTIFY_... flags. */
     /* Cluster */
@@ -1637,6 +1661,8 @@ struct redisServer
                                       REDISMODULE_CLUSTER_FLAG_*. */
     int cluster_allow_reads_when_down; /* Are reads allowed when the cluster
                                         is down? */
+    int cluster_compact_bus;           /* Use compact PING/PONG messages with
+                                          nodes supporting them. */
     int cluster_config_file_lock_fd;   /* cluster config fd, will be flock */
     /* Scripting */
     lua_State *lua;                     /* The Lua interpreter. We use just one for all clients */
@@ -1658,6 +1684,7 @@ struct redisServer
                              execution. */
     int lua_kill;                       /* Kill the script if true. */
     int lua_always_replicate_commands;  /* Default replication type. */
+    int lua_script_cache_persist;       /* Save the scripts cache in the RDB. */
     int lua_oom;                        /* OOM detected when script start? */
     /* Lazy free */
     int lazyfree_lazy_eviction;
@@ -1821,6 +1848,7 @@ extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
 extern dictType keyptrDictType;
+extern dictType pubsubPatternIndexDictType;
 extern dictType modulesDictType;
 
 /*-----------------------------------------------------------------------------
@@ -1949,6 +1977,7 @@ void blockingOperationStarts();
 void blockingOperationEnds();
 int handleClientsWithPendingWrites(void);
 int handleClientsWithPendingWritesUsingThreads(void);
+void addReplyToClientsUsingThreads(list *clients, robj **replies);
 int handleClientsWithPendingReadsUsingThreads(void);
 int stopThreadedIOIfNeeded(void);
 int clientHasPendingReplies(client *c);
@@ -2032,6 +2061,8 @@ int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
 robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
+#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
+size_t objectComputeSize(robj *o, size_t sample_size);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongLongForValue(long long value);
 robj *createStringObjectFromLongDouble(long double value, int humanfriendly);
@@ -2041,7 +2072,7 @@ robj *createSetObject(void);
 robj *createIntsetObject(void);
 robj *createHashObject(void);
 robj *createZsetObject(void);
-robj *createZsetZiplistObject(void);
+robj *createZsetListpackObject(void);
 robj *createStreamObject(void);
 robj *createModuleObject(moduleType *mt, void *value);
 int getLongFromObjectOrReply(client *c, robj *o, long *target, const char *msg);
@@ -2218,14 +2249,14 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range);
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range);
 unsigned long zsetLength(const robj *zobj);
 void zsetConvert(robj *zobj, int encoding);
-void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen);
+void zsetConvertToListpackIfNeeded(robj *zobj, size_t maxelelen);
 int zsetScore(robj *zobj, sds member, double *score);
 unsigned long zslGetRank(zskiplist *zsl, double score, sds o);
 int zsetAdd(robj *zobj, double score, sds ele, int *flags, double *newscore);
 long zsetRank(robj *zobj, sds ele, int reverse);
 int zsetDel(robj *zobj, sds ele);
 void genericZpopCommand(client *c, robj **keyv, int keyc, int where, int emitkey, robj *countarg);
-sds ziplistGetObject(unsigned char *sptr);
+sds lpGetObject(unsigned char *sptr);
 int zslValueGteMin(double value, zrangespec *spec);
 int zslValueLteMax(double value, zrangespec *spec);
 void zslFreeLexRange(zlexrangespec *spec);
@@ -2276,6 +2307,7 @@ void closeListeningSockets(int unlink_unix_socket);
 void updateCachedTime(int update_daylight_info);
 void resetServerStats(void);
 void activeDefragCycle(void);
+unsigned long activeDefragPendingCandidates(void);
 unsigned int getLRUClock(void);
 unsigned int LRU_CLOCK(void);
 const char *evictPolicyToString(void);
@@ -2316,10 +2348,10 @@ unsigned long hashTypeLength(const robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
-                                unsigned char **vstr,
-                                unsigned int *vlen,
-                                long long *vll);
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
+                                 unsigned char **vstr,
+                                 unsigned int *vlen,
+                                 long long *vll);
 sds hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what);
 void hashTypeCurrentObject(hashTypeIterator *hi, int what, unsigned char **vstr, unsigned int *vlen, long long *vll);
 sds hashTypeCurrentObjectNewSds(hashTypeIterator *hi, int what);
@@ -2391,17 +2423,23 @@ int selectDb(client *c, int id);
 void signalModifiedKey(client *c, redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
 unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
+unsigned int getKeysInSlotAfter(unsigned int hashslot, sds after, robj **keys, unsigned int count);
 unsigned int countKeysInSlot(unsigned int hashslot);
+size_t getSlotMemoryUsage(unsigned int hashslot);
 unsigned int delKeysInSlot(unsigned int hashslot);
 int verifyClusterConfigWithData(void);
 void scanGenericCommand(client *c, robj *o, unsigned long cursor);
 int parseScanCursorOrReply(client *c, robj *o, unsigned long *cursor);
-void slotToKeyAdd(sds key);
-void slotToKeyDel(sds key);
-void slotToKeyFlush(void);
+size_t dbDictEntryMetadataSize(dict *d);
+void slotToKeyInit(redisDb *db);
+void slotToKeyAddEntry(dictEntry *entry, redisDb *db);
+void slotToKeyDelEntry(dictEntry *entry, redisDb *db);
+void slotToKeyReplaceEntry(dictEntry *entry, redisDb *db);
+void slotToKeyUpdateMemory(redisDb *db, robj *key);
+void slotToKeyFlush(redisDb *db);
+void slotToKeyDestroy(redisDb *db);
 int dbAsyncDelete(redisDb *db, robj *key);
 void emptyDbAsync(redisDb *db);
-void slotToKeyFlushAsync(void);
 size_t lazyfreeGetPendingObjectsCount(void);
 void freeObjAsync(robj *o);
 
@@ -2426,6 +2464,9 @@ unsigned int keyHashSlot(char *key, int keylen);
 void clusterCron(void);
 void clusterPropagatePublish(robj *channel, robj *message);
 void migrateCloseTimedoutSockets(void);
+void asyncMigrateCron(void);
+void asyncMigrateKeyModified(redisDb *db, robj *key);
+void asyncMigrateDbFlushed(int dbid);
 void clusterBeforeSleep(void);
 int clusterSendModuleMessageToTarget(const char *target, uint64_t module_id, uint8_t type, unsigned char *payload, uint32_t len);
 
@@ -2447,6 +2488,15 @@ int ldbRemoveChild(pid_t pid);
 void ldbKillForkedSessions(void);
 int ldbPendingChildren(void);
 sds luaCreateFunction(client *c, lua_State *lua, robj *body);
+sds luaRegisterScript(robj *body);
+void luaReplyProto(const char *s, size_t len);
+int luaReplyIsPending(void);
+void luaReplyString(const char *s, size_t len);
+void luaReplyLongLong(long long ll);
+void luaReplyStatus(const char *s, size_t len, int error);
+void luaReplyAggregateLen(long length, int prefix);
+void *luaReplyDeferredLen(void);
+void luaReplySetDeferredLen(void *token, long length, int prefix);
 
 /* Blocked clients */
 void processUnblockedClients(void);
@@ -2650,6 +2700,7 @@ void unwatchCommand(client *c);
 void clusterCommand(client *c);
 void restoreCommand(client *c);
 void migrateCommand(client *c);
+void asyncMigrateCommand(client *c);
 void askingCommand(client *c);
 void readonlyCommand(client *c);
 void readwriteCommand(client *c);
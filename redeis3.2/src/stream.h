@@ -61,6 +61,17 @@ typedef struct streamCG {
     rax *consumers;         /* A radix tree representing the consumers by name
                                and their associated representation in the form
                                of streamConsumer structures. */
+    rax *pel_by_time;       /* Secondary index of the PEL ordered by delivery
+                               time: the key is the delivery time as a 64 bit
+                               big endian number followed by the entry ID,
+                               the value is the same streamNACK referenced
+                               by the "pel" radix tree. Used in order to find
+                               the oldest delivered (idle) entries. */
+    struct streamNACKChunk *nack_chunks; /* Arrays the NACKs are packed in,
+                                            the ones with free slots first. */
+    struct streamNACKChunk *nack_chunks_tail;
+    size_t nack_chunks_count;            /* Number of allocated chunks. */
+    size_t nack_slots_count;             /* Total slots in the chunks. */
 } streamCG;
 
 /* A specific consumer in a consumer group.  */
@@ -86,6 +97,32 @@ typedef struct streamNACK {
                                    in the last delivery. */
 } streamNACK;
 
+/* NACKs are not allocated one by one: every consumer group owns chunks of
+ * packed streamNACK structures, and the free NACKs of every chunk are linked
+ * together using the slot memory itself. This saves the allocator overhead
+ * of millions of tiny allocations in groups with big PELs. Chunks grow
+ * progressively, from STREAM_NACK_CHUNK_MIN to STREAM_NACK_CHUNK_MAX slots,
+ * so that groups with just a few pending entries stay small, and a chunk is
+ * released as soon as all its slots are free. */
+#define STREAM_NACK_CHUNK_MIN 4
+#define STREAM_NACK_CHUNK_MAX 128
+
+typedef struct streamNACKSlot {
+    union {
+        streamNACK nack;
+        struct streamNACKSlot *next; /* Next free slot, when not in use. */
+    } u;
+    struct streamNACKChunk *chunk;   /* Chunk the slot belongs to. */
+} streamNACKSlot;
+
+typedef struct streamNACKChunk {
+    struct streamNACKChunk *prev, *next;
+    streamNACKSlot *free;       /* Free slots of this chunk. */
+    uint32_t size;              /* Number of slots. */
+    uint32_t used;              /* Number of slots in use. */
+    streamNACKSlot slots[];
+} streamNACKChunk;
+
 /* Stream propagation informations, passed to functions in order to propagate
  * XCLAIM commands to AOF and slaves. */
 typedef struct streamPropInfo {
@@ -112,10 +149,13 @@ void streamIteratorStop(streamIterator *si);
 streamCG *streamLookupCG(stream *s, sds groupname);
 streamConsumer *streamLookupConsumer(streamCG *cg, sds name, int flags, int *created);
 streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id);
-streamNACK *streamCreateNACK(streamConsumer *consumer);
+streamNACK *streamCreateNACK(streamCG *cg, streamConsumer *consumer);
 void streamDecodeID(void *buf, streamID *id);
 int streamCompareID(streamID *a, streamID *b);
-void streamFreeNACK(streamNACK *na);
+void streamFreeNACK(streamCG *cg, streamNACK *na);
+void streamIndexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack);
+void streamUnindexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack);
+void streamNACKSetDeliveryTime(streamCG *cg, unsigned char *rawid, streamNACK *nack, mstime_t t);
 void streamIncrID(streamID *id);
 void streamPropagateConsumerCreation(client *c, robj *key, robj *groupname, sds consumername);
 
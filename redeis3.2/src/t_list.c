@@ -394,6 +394,51 @@ void rpopCommand(client *c) {
     popGenericCommand(c,LIST_TAIL);
 }
 
+/* quicklistRangeByNode() callback used by LRANGE: emit 'count' ziplist
+ * entries starting at 'p' as bulk replies. The protocol of the entries is
+ * built in a local buffer, so the client reply buffer is appended to a few
+ * times per quicklist node instead of three times per entry. */
+void addListRangeReplyFromZiplist(void *privdata, unsigned char *zl,
+                                  unsigned char *p, unsigned long count)
+{
+    client *c = privdata;
+    char buf[PROTO_REPLY_CHUNK_BYTES];
+    char num[LONG_STR_SIZE];
+    size_t used = 0;
+
+    while(count--) {
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vlong;
+
+        serverAssert(p != NULL);
+        ziplistGet(p,&vstr,&vlen,&vlong);
+        if (!vstr) {
+            vlen = ll2string(num,sizeof(num),vlong);
+            vstr = (unsigned char*)num;
+        }
+        /* "$<len>\r\n<data>\r\n" takes at most vlen+LONG_STR_SIZE+5 bytes. */
+        if (used+vlen+LONG_STR_SIZE+5 > sizeof(buf)) {
+            addReplyProto(c,buf,used);
+            used = 0;
+        }
+        if (vlen+LONG_STR_SIZE+5 > sizeof(buf)) {
+            addReplyBulkCBuffer(c,vstr,vlen);
+        } else {
+            buf[used++] = '$';
+            used += ll2string(buf+used,sizeof(buf)-used,vlen);
+            buf[used++] = '\r';
+            buf[used++] = '\n';
+            memcpy(buf+used,vstr,vlen);
+            used += vlen;
+            buf[used++] = '\r';
+            buf[used++] = '\n';
+        }
+        p = ziplistNext(zl,p);
+    }
+    if (used) addReplyProto(c,buf,used);
+}
+
 void lrangeCommand(client *c) {
     robj *o;
     long start, end, llen, rangelen;
@@ -422,19 +467,8 @@ void lrangeCommand(client *c) {
     /* Return the result in form of a multi-bulk reply */
     addReplyArrayLen(c,rangelen);
     if (o->encoding == OBJ_ENCODING_QUICKLIST) {
-        listTypeIterator *iter = listTypeInitIterator(o, start, LIST_TAIL);
-
-        while(rangelen--) {
-            listTypeEntry entry;
-            listTypeNext(iter, &entry);
-            quicklistEntry *qe = &entry.entry;
-            if (qe->value) {
-                addReplyBulkCBuffer(c,qe->value,qe->sz);
-            } else {
-                addReplyBulkLongLong(c,qe->longval);
-            }
-        }
-        listTypeReleaseIterator(iter);
+        quicklistRangeByNode(o->ptr,start,rangelen,
+                             addListRangeReplyFromZiplist,c);
     } else {
         serverPanic("List encoding is not QUICKLIST!");
     }
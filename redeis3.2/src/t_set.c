@@ -805,6 +805,57 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
     return 0;
 }
 
+#define SET_OP_UNION 0
+#define SET_OP_DIFF 1
+#define SET_OP_INTER 2
+
+/* Return 1 if all the existing sets are intset encoded. Missing keys are
+ * passed as NULL and are ignored. */
+static int setsAreAllIntsets(robj **sets, unsigned long setnum) {
+    for (unsigned long j = 0; j < setnum; j++) {
+        if (sets[j] && sets[j]->encoding != OBJ_ENCODING_INTSET) return 0;
+    }
+    return 1;
+}
+
+/* Compute the union, difference or intersection of intset encoded sets
+ * (see setsAreAllIntsets()) combining them from left to right with the
+ * sorted array kernels of intset.c, that are much faster than adding or
+ * looking up the elements one by one. Missing keys (NULL) are treated as
+ * empty sets. The result is returned as a new set object. */
+static robj *setTypeIntsetOperation(robj **sets, unsigned long setnum,
+                                    int op)
+{
+    intset *is = intsetNew();
+    robj *dstset;
+
+    for (unsigned long j = 0; j < setnum; j++) {
+        intset *tmp;
+
+        if (!sets[j]) {
+            if (j == 0 && op != SET_OP_UNION) break;
+            continue;
+        }
+        if (j == 0 || op == SET_OP_UNION)
+            tmp = intsetUnion(is,sets[j]->ptr);
+        else if (op == SET_OP_DIFF)
+            tmp = intsetDifference(is,sets[j]->ptr);
+        else
+            tmp = intsetIntersection(is,sets[j]->ptr);
+        zfree(is);
+        is = tmp;
+
+        /* Nothing more to remove or intersect. */
+        if (op != SET_OP_UNION && intsetLen(is) == 0) break;
+    }
+
+    dstset = createObject(OBJ_SET,is);
+    dstset->encoding = OBJ_ENCODING_INTSET;
+    if (intsetLen(is) > server.set_max_intset_entries)
+        setTypeConvert(dstset,OBJ_ENCODING_HT);
+    return dstset;
+}
+
 void sinterGenericCommand(client *c, robj **setkeys,
                           unsigned long setnum, robj *dstkey) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
@@ -843,70 +894,87 @@ void sinterGenericCommand(client *c, robj **setkeys,
      * algorithm's performance */
     qsort(sets,setnum,sizeof(robj*),qsortCompareSetsByCardinality);
 
-    /* The first thing we should output is the total number of elements...
-     * since this is a multi-bulk write, but at this stage we don't know
-     * the intersection set size, so we use a trick, append an empty object
-     * to the output list and save the pointer to later modify it with the
-     * right length */
-    if (!dstkey) {
-        replylen = addReplyDeferredLen(c);
+    if (setsAreAllIntsets(sets,setnum)) {
+        /* Only intsets: merge the sorted arrays. */
+        dstset = setTypeIntsetOperation(sets,setnum,SET_OP_INTER);
+        if (!dstkey) {
+            addReplySetLen(c,setTypeSize(dstset));
+            si = setTypeInitIterator(dstset);
+            while((encoding = setTypeNext(si,&elesds,&intobj)) != -1) {
+                if (encoding == OBJ_ENCODING_HT)
+                    addReplyBulkCBuffer(c,elesds,sdslen(elesds));
+                else
+                    addReplyBulkLongLong(c,intobj);
+            }
+            setTypeReleaseIterator(si);
+            decrRefCount(dstset);
+        }
     } else {
-        /* If we have a target key where to store the resulting set
-         * create this key with an empty set inside */
-        dstset = createIntsetObject();
-    }
+        /* The first thing we should output is the total number of elements...
+         * since this is a multi-bulk write, but at this stage we don't know
+         * the intersection set size, so we use a trick, append an empty object
+         * to the output list and save the pointer to later modify it with the
+         * right length */
+        if (!dstkey) {
+            replylen = addReplyDeferredLen(c);
+        } else {
+            /* If we have a target key where to store the resulting set
+             * create this key with an empty set inside */
+            dstset = createIntsetObject();
+        }
 
-    /* Iterate all the elements of the first (smallest) set, and test
-     * the element against all the other sets, if at least one set does
-     * not include the element it is discarded */
-    si = setTypeInitIterator(sets[0]);
-    while((encoding = setTypeNext(si,&elesds,&intobj)) != -1) {
-        for (j = 1; j < setnum; j++) {
-            if (sets[j] == sets[0]) continue;
-            if (encoding == OBJ_ENCODING_INTSET) {
-                /* intset with intset is simple... and fast */
-                if (sets[j]->encoding == OBJ_ENCODING_INTSET &&
-                    !intsetFind((intset*)sets[j]->ptr,intobj))
-                {
-                    break;
-                /* in order to compare an integer with an object we
-                 * have to use the generic function, creating an object
-                 * for this */
-                } else if (sets[j]->encoding == OBJ_ENCODING_HT) {
-                    elesds = sdsfromlonglong(intobj);
-                    if (!setTypeIsMember(sets[j],elesds)) {
+        /* Iterate all the elements of the first (smallest) set, and test
+         * the element against all the other sets, if at least one set does
+         * not include the element it is discarded */
+        si = setTypeInitIterator(sets[0]);
+        while((encoding = setTypeNext(si,&elesds,&intobj)) != -1) {
+            for (j = 1; j < setnum; j++) {
+                if (sets[j] == sets[0]) continue;
+                if (encoding == OBJ_ENCODING_INTSET) {
+                    /* intset with intset is simple... and fast */
+                    if (sets[j]->encoding == OBJ_ENCODING_INTSET &&
+                        !intsetFind((intset*)sets[j]->ptr,intobj))
+                    {
+                        break;
+                    /* in order to compare an integer with an object we
+                     * have to use the generic function, creating an object
+                     * for this */
+                    } else if (sets[j]->encoding == OBJ_ENCODING_HT) {
+                        elesds = sdsfromlonglong(intobj);
+                        if (!setTypeIsMember(sets[j],elesds)) {
+                            sdsfree(elesds);
+                            break;
+                        }
                         sdsfree(elesds);
+                    }
+                } else if (encoding == OBJ_ENCODING_HT) {
+                    if (!setTypeIsMember(sets[j],elesds)) {
                         break;
                     }
-                    sdsfree(elesds);
-                }
-            } else if (encoding == OBJ_ENCODING_HT) {
-                if (!setTypeIsMember(sets[j],elesds)) {
-                    break;
                 }
             }
-        }
 
-        /* Only take action when all sets contain the member */
-        if (j == setnum) {
-            if (!dstkey) {
-                if (encoding == OBJ_ENCODING_HT)
-                    addReplyBulkCBuffer(c,elesds,sdslen(elesds));
-                else
-                    addReplyBulkLongLong(c,intobj);
-                cardinality++;
-            } else {
-                if (encoding == OBJ_ENCODING_INTSET) {
-                    elesds = sdsfromlonglong(intobj);
-                    setTypeAdd(dstset,elesds);
-                    sdsfree(elesds);
+            /* Only take action when all sets contain the member */
+            if (j == setnum) {
+                if (!dstkey) {
+                    if (encoding == OBJ_ENCODING_HT)
+                        addReplyBulkCBuffer(c,elesds,sdslen(elesds));
+                    else
+                        addReplyBulkLongLong(c,intobj);
+                    cardinality++;
                 } else {
-                    setTypeAdd(dstset,elesds);
+                    if (encoding == OBJ_ENCODING_INTSET) {
+                        elesds = sdsfromlonglong(intobj);
+                        setTypeAdd(dstset,elesds);
+                        sdsfree(elesds);
+                    } else {
+                        setTypeAdd(dstset,elesds);
+                    }
                 }
             }
         }
+        setTypeReleaseIterator(si);
     }
-    setTypeReleaseIterator(si);
 
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
@@ -926,7 +994,7 @@ void sinterGenericCommand(client *c, robj **setkeys,
             }
         }
         decrRefCount(dstset);
-    } else {
+    } else if (replylen) {
         setDeferredSetLen(c,replylen,cardinality);
     }
     zfree(sets);
@@ -940,10 +1008,6 @@ void sinterstoreCommand(client *c) {
     sinterGenericCommand(c,c->argv+2,c->argc-2,c->argv[1]);
 }
 
-#define SET_OP_UNION 0
-#define SET_OP_DIFF 1
-#define SET_OP_INTER 2
-
 void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
                               robj *dstkey, int op) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
@@ -1004,9 +1068,18 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
     /* We need a temp set object to store our union. If the dstkey
      * is not NULL (that is, we are inside an SUNIONSTORE operation) then
      * this set object will be the resulting object to set into the target key*/
-    dstset = createIntsetObject();
+    int intset_algo = setsAreAllIntsets(sets,setnum);
+    if (intset_algo) {
+        /* Only intsets: merge the sorted arrays. */
+        dstset = setTypeIntsetOperation(sets,setnum,op);
+        cardinality = setTypeSize(dstset);
+    } else {
+        dstset = createIntsetObject();
+    }
 
-    if (op == SET_OP_UNION) {
+    if (intset_algo) {
+        /* Already computed. */
+    } else if (op == SET_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
         for (j = 0; j < setnum; j++) {
@@ -1073,11 +1146,14 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
 
     /* Output the content of the resulting set, if not in STORE mode */
     if (!dstkey) {
+        int64_t intele;
         addReplySetLen(c,cardinality);
         si = setTypeInitIterator(dstset);
-        while((ele = setTypeNextObject(si)) != NULL) {
-            addReplyBulkCBuffer(c,ele,sdslen(ele));
-            sdsfree(ele);
+        while(setTypeNext(si,&ele,&intele) != -1) {
+            if (si->encoding == OBJ_ENCODING_INTSET)
+                addReplyBulkLongLong(c,intele);
+            else
+                addReplyBulkCBuffer(c,ele,sdslen(ele));
         }
         setTypeReleaseIterator(si);
         server.lazyfree_lazy_server_del ? freeObjAsync(dstset) :
@@ -44,8 +44,7 @@
 #define STREAMID_STATIC_VECTOR_LEN 8
 
 void streamFreeCG(streamCG *cg);
-void streamFreeNACK(streamNACK *na);
-size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamConsumer *consumer);
+size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamCG *group, streamConsumer *consumer);
 
 /* -----------------------------------------------------------------------
  * Low level stream encoding: a radix tree of listpacks.
@@ -982,7 +981,7 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
      * as delivered. */
     if (group && (flags & STREAM_RWR_HISTORY)) {
         return streamReplyWithRangeFromConsumerPEL(c,s,start,end,count,
-                                                   consumer);
+                                                   group,consumer);
     }
 
     if (!(flags & STREAM_RWR_RAWENTRIES))
@@ -1030,7 +1029,7 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
             /* Try to add a new NACK. Most of the time this will work and
              * will not require extra lookups. We'll fix the problem later
              * if we find that there is already a entry for this ID. */
-            streamNACK *nack = streamCreateNACK(consumer);
+            streamNACK *nack = streamCreateNACK(group,consumer);
             int group_inserted =
                 raxTryInsert(group->pel,buf,sizeof(buf),nack,NULL);
             int consumer_inserted =
@@ -1040,18 +1039,20 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
              * in that case reassign the entry to the new consumer,
              * or update it if the consumer is the same as before. */
             if (group_inserted == 0) {
-                streamFreeNACK(nack);
+                streamFreeNACK(group,nack);
                 nack = raxFind(group->pel,buf,sizeof(buf));
                 serverAssert(nack != raxNotFound);
                 raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
                 /* Update the consumer and NACK metadata. */
                 nack->consumer = consumer;
-                nack->delivery_time = mstime();
+                streamNACKSetDeliveryTime(group,buf,nack,mstime());
                 nack->delivery_count = 1;
                 /* Add the entry in the new consumer local PEL. */
                 raxInsert(consumer->pel,buf,sizeof(buf),nack,NULL);
             } else if (group_inserted == 1 && consumer_inserted == 0) {
                 serverPanic("NACK half-created. Should not be possible.");
+            } else {
+                streamIndexNACK(group,buf,nack);
             }
 
             /* Propagate as XCLAIM. */
@@ -1087,7 +1088,7 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
  * seek into the radix tree of the messages in order to emit the full message
  * to the client. However clients only reach this code path when they are
  * fetching the history of already retrieved messages, which is rare. */
-size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamConsumer *consumer) {
+size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamCG *group, streamConsumer *consumer) {
     raxIterator ri;
     unsigned char startkey[sizeof(streamID)];
     unsigned char endkey[sizeof(streamID)];
@@ -1114,7 +1115,7 @@ size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start
             addReplyNullArray(c);
         } else {
             streamNACK *nack = ri.data;
-            nack->delivery_time = mstime();
+            streamNACKSetDeliveryTime(group,ri.key,nack,mstime());
             nack->delivery_count++;
         }
         arraylen++;
@@ -1669,20 +1670,146 @@ cleanup: /* Cleanup. */
  * Low level implementation of consumer groups
  * ----------------------------------------------------------------------- */
 
+/* Unlink the NACK chunk 'chunk' from the chunks list of the group. */
+static void streamUnlinkNACKChunk(streamCG *cg, streamNACKChunk *chunk) {
+    if (chunk->prev) chunk->prev->next = chunk->next;
+    else cg->nack_chunks = chunk->next;
+    if (chunk->next) chunk->next->prev = chunk->prev;
+    else cg->nack_chunks_tail = chunk->prev;
+    chunk->prev = chunk->next = NULL;
+}
+
+/* Link the NACK chunk 'chunk' at the head (if it has free slots) or at the
+ * tail (if it is full) of the chunks list of the group, so that the chunks
+ * with free slots always come first. */
+static void streamLinkNACKChunk(streamCG *cg, streamNACKChunk *chunk) {
+    if (chunk->free) {
+        chunk->prev = NULL;
+        chunk->next = cg->nack_chunks;
+        if (cg->nack_chunks) cg->nack_chunks->prev = chunk;
+        else cg->nack_chunks_tail = chunk;
+        cg->nack_chunks = chunk;
+    } else {
+        chunk->next = NULL;
+        chunk->prev = cg->nack_chunks_tail;
+        if (cg->nack_chunks_tail) cg->nack_chunks_tail->next = chunk;
+        else cg->nack_chunks = chunk;
+        cg->nack_chunks_tail = chunk;
+    }
+}
+
 /* Create a NACK entry setting the delivery count to 1 and the delivery
  * time to the current time. The NACK consumer will be set to the one
- * specified as argument of the function. */
-streamNACK *streamCreateNACK(streamConsumer *consumer) {
-    streamNACK *nack = zmalloc(sizeof(*nack));
+ * specified as argument of the function. The NACK is taken from the chunks
+ * of the consumer group 'cg', allocating a new chunk if there are no free
+ * slots: every new chunk is as big as all the existing ones together, within
+ * the STREAM_NACK_CHUNK_MIN and STREAM_NACK_CHUNK_MAX limits. Note that the
+ * NACK is not added to the delivery time index: this is up to the caller
+ * once the NACK is inserted in the group PEL, see streamIndexNACK(). */
+streamNACK *streamCreateNACK(streamCG *cg, streamConsumer *consumer) {
+    streamNACKChunk *chunk = cg->nack_chunks;
+
+    if (chunk == NULL || chunk->free == NULL) {
+        size_t size = cg->nack_slots_count;
+        if (size < STREAM_NACK_CHUNK_MIN) size = STREAM_NACK_CHUNK_MIN;
+        if (size > STREAM_NACK_CHUNK_MAX) size = STREAM_NACK_CHUNK_MAX;
+        chunk = zmalloc(sizeof(*chunk)+sizeof(streamNACKSlot)*size);
+        chunk->free = NULL;
+        chunk->size = size;
+        chunk->used = 0;
+        for (int j = size-1; j >= 0; j--) {
+            chunk->slots[j].chunk = chunk;
+            chunk->slots[j].u.next = chunk->free;
+            chunk->free = &chunk->slots[j];
+        }
+        streamLinkNACKChunk(cg,chunk);
+        cg->nack_chunks_count++;
+        cg->nack_slots_count += size;
+    }
+
+    streamNACKSlot *slot = chunk->free;
+    chunk->free = slot->u.next;
+    chunk->used++;
+    if (chunk->free == NULL) {
+        /* Full: move it after the chunks with free slots. */
+        streamUnlinkNACKChunk(cg,chunk);
+        streamLinkNACKChunk(cg,chunk);
+    }
+    streamNACK *nack = &slot->u.nack;
     nack->delivery_time = mstime();
     nack->delivery_count = 1;
     nack->consumer = consumer;
     return nack;
 }
 
-/* Free a NACK entry. */
-void streamFreeNACK(streamNACK *na) {
-    zfree(na);
+/* Release all the NACK chunks of the consumer group. */
+static void streamFreeNACKChunks(streamCG *cg) {
+    streamNACKChunk *chunk = cg->nack_chunks;
+    while (chunk) {
+        streamNACKChunk *next = chunk->next;
+        zfree(chunk);
+        chunk = next;
+    }
+    cg->nack_chunks = NULL;
+    cg->nack_chunks_tail = NULL;
+    cg->nack_chunks_count = 0;
+    cg->nack_slots_count = 0;
+}
+
+/* Free a NACK entry, that must be already removed from the group PEL and
+ * from the delivery time index. When the last NACK of a chunk is freed, the
+ * chunk memory is returned to the allocator. */
+void streamFreeNACK(streamCG *cg, streamNACK *na) {
+    streamNACKSlot *slot = (streamNACKSlot*)na;
+    streamNACKChunk *chunk = slot->chunk;
+    int was_full = chunk->free == NULL;
+
+    slot->u.next = chunk->free;
+    chunk->free = slot;
+    chunk->used--;
+    if (chunk->used == 0) {
+        streamUnlinkNACKChunk(cg,chunk);
+        cg->nack_chunks_count--;
+        cg->nack_slots_count -= chunk->size;
+        zfree(chunk);
+    } else if (was_full) {
+        streamUnlinkNACKChunk(cg,chunk);
+        streamLinkNACKChunk(cg,chunk);
+    }
+}
+
+/* Encode the delivery time index key of a NACK: the delivery time as a
+ * 64 bit big endian number, followed by the raw (already big endian)
+ * entry ID, so that entries delivered at the same time sort by ID. */
+static void streamEncodeNACKTimeKey(unsigned char *buf, mstime_t t, unsigned char *rawid) {
+    uint64_t ut = t < 0 ? 0 : (uint64_t)t;
+    ut = htonu64(ut);
+    memcpy(buf,&ut,sizeof(ut));
+    memcpy(buf+sizeof(ut),rawid,sizeof(streamID));
+}
+
+/* Add the NACK of the entry 'rawid' to the delivery time index of the
+ * consumer group. */
+void streamIndexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack) {
+    unsigned char key[sizeof(uint64_t)+sizeof(streamID)];
+    streamEncodeNACKTimeKey(key,nack->delivery_time,rawid);
+    raxInsert(cg->pel_by_time,key,sizeof(key),nack,NULL);
+}
+
+/* Remove the NACK of the entry 'rawid' from the delivery time index of the
+ * consumer group. Must be called before changing the NACK delivery time. */
+void streamUnindexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack) {
+    unsigned char key[sizeof(uint64_t)+sizeof(streamID)];
+    streamEncodeNACKTimeKey(key,nack->delivery_time,rawid);
+    raxRemove(cg->pel_by_time,key,sizeof(key),NULL);
+}
+
+/* Update the delivery time of an indexed NACK. */
+void streamNACKSetDeliveryTime(streamCG *cg, unsigned char *rawid, streamNACK *nack, mstime_t t) {
+    if (nack->delivery_time == t) return;
+    streamUnindexNACK(cg,rawid,nack);
+    nack->delivery_time = t;
+    streamIndexNACK(cg,rawid,nack);
 }
 
 /* Free a consumer and associated data structures. Note that this function
@@ -1709,6 +1836,11 @@ streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id) {
     streamCG *cg = zmalloc(sizeof(*cg));
     cg->pel = raxNew();
     cg->consumers = raxNew();
+    cg->pel_by_time = raxNew();
+    cg->nack_chunks = NULL;
+    cg->nack_chunks_tail = NULL;
+    cg->nack_chunks_count = 0;
+    cg->nack_slots_count = 0;
     cg->last_id = *id;
     raxInsert(s->cgroups,(unsigned char*)name,namelen,cg,NULL);
     return cg;
@@ -1716,7 +1848,10 @@ streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id) {
 
 /* Free a consumer group and all its associated data. */
 void streamFreeCG(streamCG *cg) {
-    raxFreeWithCallback(cg->pel,(void(*)(void*))streamFreeNACK);
+    /* The NACKs are owned by the chunks, no need to free them one by one. */
+    raxFree(cg->pel);
+    raxFree(cg->pel_by_time);
+    streamFreeNACKChunks(cg);
     raxFreeWithCallback(cg->consumers,(void(*)(void*))streamFreeConsumer);
     zfree(cg);
 }
@@ -1771,7 +1906,8 @@ uint64_t streamDelConsumer(streamCG *cg, sds name) {
     while(raxNext(&ri)) {
         streamNACK *nack = ri.data;
         raxRemove(cg->pel,ri.key,ri.key_len,NULL);
-        streamFreeNACK(nack);
+        streamUnindexNACK(cg,ri.key,nack);
+        streamFreeNACK(cg,nack);
     }
     raxStop(&ri);
 
@@ -2012,7 +2148,8 @@ void xackCommand(client *c) {
         if (nack != raxNotFound) {
             raxRemove(group->pel,buf,sizeof(buf),NULL);
             raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
-            streamFreeNACK(nack);
+            streamUnindexNACK(group,buf,nack);
+            streamFreeNACK(group,nack);
             acknowledged++;
             server.dirty++;
         }
@@ -2022,7 +2159,32 @@ cleanup:
     if (ids != static_ids) zfree(ids);
 }
 
-/* XPENDING <key> <group> [<start> <stop> <count> [<consumer>]]
+/* Emit a single XPENDING entry: ID, owner, idle time, deliveries. */
+static void addReplyPendingEntry(client *c, unsigned char *rawid,
+                                 streamNACK *nack, mstime_t now)
+{
+    addReplyArrayLen(c,4);
+
+    /* Entry ID. */
+    streamID id;
+    streamDecodeID(rawid,&id);
+    addReplyStreamID(c,&id);
+
+    /* Consumer name. */
+    addReplyBulkCBuffer(c,nack->consumer->name,
+                        sdslen(nack->consumer->name));
+
+    /* Milliseconds elapsed since last delivery. */
+    mstime_t elapsed = now - nack->delivery_time;
+    if (elapsed < 0) elapsed = 0;
+    addReplyLongLong(c,elapsed);
+
+    /* Number of deliveries. */
+    addReplyLongLong(c,nack->delivery_count);
+}
+
+/* XPENDING <key> <group> [[IDLE <min-idle-time>] <start> <stop> <count>
+ *          [<consumer>]]
  *
  * If start and stop are omitted, the command just outputs information about
  * the amount of pending messages for the key/group pair, together with
@@ -2030,32 +2192,50 @@ cleanup:
  *
  * If start and stop are provided instead, the pending messages are returned
  * with informations about the current owner, number of deliveries and last
- * delivery time and so forth. */
+ * delivery time and so forth.
+ *
+ * When IDLE is given only the entries idle for at least <min-idle-time>
+ * milliseconds are reported. In that case the group delivery time index is
+ * scanned instead of the PEL, so the entries are returned starting from the
+ * one delivered less recently, and the cost is proportional to the number
+ * of idle entries, not to the size of the PEL. */
 void xpendingCommand(client *c) {
     int justinfo = c->argc == 3; /* Without the range just outputs general
                                     informations about the PEL. */
     robj *key = c->argv[1];
     robj *groupname = c->argv[2];
-    robj *consumername = (c->argc == 7) ? c->argv[6] : NULL;
+    robj *consumername = NULL;
     streamID startid, endid;
-    long long count;
+    long long count, minidle = -1;
+    int argpos = 3; /* Position of <start> in the argument vector. */
 
-    /* Start and stop, and the consumer, can be omitted. */
-    if (c->argc != 3 && c->argc != 6 && c->argc != 7) {
+    if (c->argc >= 5 && !strcasecmp(c->argv[3]->ptr,"IDLE")) {
+        if (getLongLongFromObjectOrReply(c,c->argv[4],&minidle,NULL) == C_ERR)
+            return;
+        if (minidle < 0) minidle = 0;
+        argpos = 5;
+    }
+
+    /* Start and stop, and the consumer, can be omitted (but not when
+     * IDLE is given). */
+    if ((argpos == 3 && c->argc != 3 && c->argc != 6 && c->argc != 7) ||
+        (argpos == 5 && c->argc != 8 && c->argc != 9))
+    {
         addReply(c,shared.syntaxerr);
         return;
     }
+    if (c->argc == argpos+4) consumername = c->argv[argpos+3];
 
     /* Parse start/end/count arguments ASAP if needed, in order to report
      * syntax errors before any other error. */
-    if (c->argc >= 6) {
-        if (getLongLongFromObjectOrReply(c,c->argv[5],&count,NULL) == C_ERR)
-            return;
+    if (!justinfo) {
+        if (getLongLongFromObjectOrReply(c,c->argv[argpos+2],&count,NULL)
+            == C_ERR) return;
         if (count < 0) count = 0;
-        if (streamParseIDOrReply(c,c->argv[3],&startid,0) == C_ERR)
-            return;
-        if (streamParseIDOrReply(c,c->argv[4],&endid,UINT64_MAX) == C_ERR)
+        if (streamParseIDOrReply(c,c->argv[argpos],&startid,0) == C_ERR)
             return;
+        if (streamParseIDOrReply(c,c->argv[argpos+1],&endid,UINT64_MAX)
+            == C_ERR) return;
     }
 
     /* Lookup the key and the group inside the stream. */
@@ -2115,7 +2295,8 @@ void xpendingCommand(client *c) {
             raxStop(&ri);
         }
     }
-    /* XPENDING <key> <group> <start> <stop> <count> [<consumer>] variant. */
+    /* XPENDING <key> <group> [IDLE <min-idle-time>] <start> <stop> <count>
+     * [<consumer>] variant. */
     else {
         streamConsumer *consumer = NULL;
         if (consumername) {
@@ -2132,7 +2313,6 @@ void xpendingCommand(client *c) {
             }
         }
 
-        rax *pel = consumer ? consumer->pel : group->pel;
         unsigned char startkey[sizeof(streamID)];
         unsigned char endkey[sizeof(streamID)];
         raxIterator ri;
@@ -2140,34 +2320,38 @@ void xpendingCommand(client *c) {
 
         streamEncodeID(startkey,&startid);
         streamEncodeID(endkey,&endid);
-        raxStart(&ri,pel);
-        raxSeek(&ri,">=",startkey,sizeof(startkey));
         void *arraylen_ptr = addReplyDeferredLen(c);
         size_t arraylen = 0;
 
-        while(count && raxNext(&ri) && memcmp(ri.key,endkey,ri.key_len) <= 0) {
-            streamNACK *nack = ri.data;
-
-            arraylen++;
-            count--;
-            addReplyArrayLen(c,4);
-
-            /* Entry ID. */
-            streamID id;
-            streamDecodeID(ri.key,&id);
-            addReplyStreamID(c,&id);
-
-            /* Consumer name. */
-            addReplyBulkCBuffer(c,nack->consumer->name,
-                                sdslen(nack->consumer->name));
-
-            /* Milliseconds elapsed since last delivery. */
-            mstime_t elapsed = now - nack->delivery_time;
-            if (elapsed < 0) elapsed = 0;
-            addReplyLongLong(c,elapsed);
-
-            /* Number of deliveries. */
-            addReplyLongLong(c,nack->delivery_count);
+        if (minidle == -1) {
+            rax *pel = consumer ? consumer->pel : group->pel;
+            raxStart(&ri,pel);
+            raxSeek(&ri,">=",startkey,sizeof(startkey));
+            while(count && raxNext(&ri) &&
+                  memcmp(ri.key,endkey,ri.key_len) <= 0)
+            {
+                addReplyPendingEntry(c,ri.key,ri.data,now);
+                arraylen++;
+                count--;
+            }
+        } else {
+            /* Keys of the time index are the big endian delivery time
+             * followed by the entry ID: stop at the first entry delivered
+             * after 'now - minidle'. */
+            mstime_t maxtime = now - minidle;
+            raxStart(&ri,group->pel_by_time);
+            raxSeek(&ri,"^",NULL,0);
+            while(count && raxNext(&ri)) {
+                streamNACK *nack = ri.data;
+                unsigned char *rawid = ri.key+sizeof(uint64_t);
+                if (nack->delivery_time > maxtime) break;
+                if (consumer && nack->consumer != consumer) continue;
+                if (memcmp(rawid,startkey,sizeof(startkey)) < 0 ||
+                    memcmp(rawid,endkey,sizeof(endkey)) > 0) continue;
+                addReplyPendingEntry(c,rawid,nack,now);
+                arraylen++;
+                count--;
+            }
         }
         raxStop(&ri);
         setDeferredArrayLen(c,arraylen_ptr,arraylen);
@@ -2371,8 +2555,9 @@ void xclaimCommand(client *c) {
             if (!found) continue;
 
             /* Create the NACK. */
-            nack = streamCreateNACK(NULL);
+            nack = streamCreateNACK(group,NULL);
             raxInsert(group->pel,buf,sizeof(buf),nack,NULL);
+            streamIndexNACK(group,buf,nack);
         }
 
         if (nack != raxNotFound) {
@@ -2395,7 +2580,7 @@ void xclaimCommand(client *c) {
             if (consumer == NULL)
                 consumer = streamLookupConsumer(group,c->argv[3]->ptr,SLC_NONE,NULL);
             nack->consumer = consumer;
-            nack->delivery_time = deliverytime;
+            streamNACKSetDeliveryTime(group,buf,nack,deliverytime);
             /* Set the delivery attempts counter if given, otherwise
              * autoincrement unless JUSTID option provided */
             if (retrycount >= 0) {
@@ -916,7 +916,7 @@ zskiplistNode *zslLastInLexRange(zskiplist *zsl, zlexrangespec *range)
 }
 
 /*-----------------------------------------------------------------------------
- * Ziplist-backed sorted set API
+ * Listpack-backed sorted set API
  *----------------------------------------------------------------------------*/
 
 double zzlGetScore(unsigned char *sptr)
@@ -928,7 +928,7 @@ double zzlGetScore(unsigned char *sptr)
     double score;
 
     serverAssert(sptr != NULL);
-    serverAssert(ziplistGet(sptr, &vstr, &vlen, &vlong));
+    vstr = lpGetValue(sptr, &vlen, &vlong);
 
     if (vstr)
     {
@@ -944,15 +944,15 @@ double zzlGetScore(unsigned char *sptr)
     return score;
 }
 
-/* Return a ziplist element as an SDS string. */
-sds ziplistGetObject(unsigned char *sptr)
+/* Return a listpack element as an SDS string. */
+sds lpGetObject(unsigned char *sptr)
 {
     unsigned char *vstr;
     unsigned int vlen;
     long long vlong;
 
     serverAssert(sptr != NULL);
-    serverAssert(ziplistGet(sptr, &vstr, &vlen, &vlong));
+    vstr = lpGetValue(sptr, &vlen, &vlong);
 
     if (vstr)
     {
@@ -973,7 +973,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
     unsigned char vbuf[32];
     int minlen, cmp;
 
-    serverAssert(ziplistGet(eptr, &vstr, &vlen, &vlong));
+    vstr = lpGetValue(eptr, &vlen, &vlong);
     if (vstr == NULL)
     {
         /* Store string representation of long long in buf. */
@@ -990,7 +990,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
 
 unsigned int zzlLength(unsigned char *zl)
 {
-    return ziplistLen(zl) / 2;
+    return lpLength(zl) / 2;
 }
 
 /* Move to next entry based on the values in eptr and sptr. Both are set to
@@ -1000,10 +1000,10 @@ void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr)
     unsigned char *_eptr, *_sptr;
     serverAssert(*eptr != NULL && *sptr != NULL);
 
-    _eptr = ziplistNext(zl, *sptr);
+    _eptr = lpNext(zl, *sptr);
     if (_eptr != NULL)
     {
-        _sptr = ziplistNext(zl, _eptr);
+        _sptr = lpNext(zl, _eptr);
         serverAssert(_sptr != NULL);
     }
     else
@@ -1023,10 +1023,10 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr)
     unsigned char *_eptr, *_sptr;
     serverAssert(*eptr != NULL && *sptr != NULL);
 
-    _sptr = ziplistPrev(zl, *eptr);
+    _sptr = lpPrev(zl, *eptr);
     if (_sptr != NULL)
     {
-        _eptr = ziplistPrev(zl, _sptr);
+        _eptr = lpPrev(zl, _sptr);
         serverAssert(_eptr != NULL);
     }
     else
@@ -1051,14 +1051,14 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range)
         (range->min == range->max && (range->minex || range->maxex)))
         return 0;
 
-    p = ziplistIndex(zl, -1); /* Last score. */
+    p = lpSeek(zl, -1); /* Last score. */
     if (p == NULL)
         return 0; /* Empty sorted set */
     score = zzlGetScore(p);
     if (!zslValueGteMin(score, range))
         return 0;
 
-    p = ziplistIndex(zl, 1); /* First score. */
+    p = lpSeek(zl, 1); /* First score. */
     serverAssert(p != NULL);
     score = zzlGetScore(p);
     if (!zslValueLteMax(score, range))
@@ -1071,7 +1071,7 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range)
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range)
 {
-    unsigned char *eptr = ziplistIndex(zl, 0), *sptr;
+    unsigned char *eptr = lpFirst(zl), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
@@ -1080,7 +1080,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range)
 
     while (eptr != NULL)
     {
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssert(sptr != NULL);
 
         score = zzlGetScore(sptr);
@@ -1093,7 +1093,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range)
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl, sptr);
+        eptr = lpNext(zl, sptr);
     }
 
     return NULL;
@@ -1103,7 +1103,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range)
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range)
 {
-    unsigned char *eptr = ziplistIndex(zl, -2), *sptr;
+    unsigned char *eptr = lpSeek(zl, -2), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
@@ -1112,7 +1112,7 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range)
 
     while (eptr != NULL)
     {
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssert(sptr != NULL);
 
         score = zzlGetScore(sptr);
@@ -1126,9 +1126,9 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range)
 
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl, eptr);
+        sptr = lpPrev(zl, eptr);
         if (sptr != NULL)
-            serverAssert((eptr = ziplistPrev(zl, sptr)) != NULL);
+            serverAssert((eptr = lpPrev(zl, sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -1138,7 +1138,7 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range)
 
 int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec)
 {
-    sds value = ziplistGetObject(p);
+    sds value = lpGetObject(p);
     int res = zslLexValueGteMin(value, spec);
     sdsfree(value);
     return res;
@@ -1146,7 +1146,7 @@ int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec)
 
 int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec)
 {
-    sds value = ziplistGetObject(p);
+    sds value = lpGetObject(p);
     int res = zslLexValueLteMax(value, spec);
     sdsfree(value);
     return res;
@@ -1163,13 +1163,13 @@ int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range)
     if (cmp > 0 || (cmp == 0 && (range->minex || range->maxex)))
         return 0;
 
-    p = ziplistIndex(zl, -2); /* Last element. */
+    p = lpSeek(zl, -2); /* Last element. */
     if (p == NULL)
         return 0;
     if (!zzlLexValueGteMin(p, range))
         return 0;
 
-    p = ziplistIndex(zl, 0); /* First element. */
+    p = lpFirst(zl); /* First element. */
     serverAssert(p != NULL);
     if (!zzlLexValueLteMax(p, range))
         return 0;
@@ -1181,7 +1181,7 @@ int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range)
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range)
 {
-    unsigned char *eptr = ziplistIndex(zl, 0), *sptr;
+    unsigned char *eptr = lpFirst(zl), *sptr;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInLexRange(zl, range))
@@ -1198,9 +1198,9 @@ unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range)
         }
 
         /* Move to next element. */
-        sptr = ziplistNext(zl, eptr); /* This element score. Skip it. */
+        sptr = lpNext(zl, eptr); /* This element score. Skip it. */
         serverAssert(sptr != NULL);
-        eptr = ziplistNext(zl, sptr); /* Next element. */
+        eptr = lpNext(zl, sptr); /* Next element. */
     }
 
     return NULL;
@@ -1210,7 +1210,7 @@ unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range)
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range)
 {
-    unsigned char *eptr = ziplistIndex(zl, -2), *sptr;
+    unsigned char *eptr = lpSeek(zl, -2), *sptr;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInLexRange(zl, range))
@@ -1228,9 +1228,9 @@ unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range)
 
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl, eptr);
+        sptr = lpPrev(zl, eptr);
         if (sptr != NULL)
-            serverAssert((eptr = ziplistPrev(zl, sptr)) != NULL);
+            serverAssert((eptr = lpPrev(zl, sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -1240,14 +1240,14 @@ unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range)
 
 unsigned char *zzlFind(unsigned char *zl, sds ele, double *score)
 {
-    unsigned char *eptr = ziplistIndex(zl, 0), *sptr;
+    unsigned char *eptr = lpFirst(zl), *sptr;
 
     while (eptr != NULL)
     {
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssert(sptr != NULL);
 
-        if (ziplistCompare(eptr, (unsigned char *)ele, sdslen(ele)))
+        if (lpCompare(eptr, (unsigned char *)ele, sdslen(ele)))
         {
             /* Matching element, pull out score. */
             if (score != NULL)
@@ -1256,20 +1256,19 @@ unsigned char *zzlFind(unsigned char *zl, sds ele, double *score)
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl, sptr);
+        eptr = lpNext(zl, sptr);
     }
     return NULL;
 }
 
-/* Delete (element,score) pair from ziplist. Use local copy of eptr because we
+/* Delete (element,score) pair from listpack. Use local copy of eptr because we
  * don't want to modify the one given as argument. */
 unsigned char *zzlDelete(unsigned char *zl, unsigned char *eptr)
 {
     unsigned char *p = eptr;
 
-    /* TODO: add function to ziplist API to delete N elements from offset. */
-    zl = ziplistDelete(zl, &p);
-    zl = ziplistDelete(zl, &p);
+    zl = lpDelete(zl, p, &p);
+    zl = lpDelete(zl, p, NULL);
     return zl;
 }
 
@@ -1278,38 +1277,35 @@ unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, sds ele, doub
     unsigned char *sptr;
     char scorebuf[128];
     int scorelen;
-    size_t offset;
 
     scorelen = d2string(scorebuf, sizeof(scorebuf), score);
     if (eptr == NULL)
     {
-        zl = ziplistPush(zl, (unsigned char *)ele, sdslen(ele), ZIPLIST_TAIL);
-        zl = ziplistPush(zl, (unsigned char *)scorebuf, scorelen, ZIPLIST_TAIL);
+        zl = lpAppend(zl, (unsigned char *)ele, sdslen(ele));
+        zl = lpAppend(zl, (unsigned char *)scorebuf, scorelen);
     }
     else
     {
-        /* Keep offset relative to zl, as it might be re-allocated. */
-        offset = eptr - zl;
-        zl = ziplistInsert(zl, eptr, (unsigned char *)ele, sdslen(ele));
-        eptr = zl + offset;
+        /* Insert the element before eptr: lpInsert() returns the address of
+         * the new element, valid even if the listpack was re-allocated. */
+        zl = lpInsert(zl, (unsigned char *)ele, sdslen(ele), eptr, LP_BEFORE, &sptr);
 
         /* Insert score after the element. */
-        serverAssert((sptr = ziplistNext(zl, eptr)) != NULL);
-        zl = ziplistInsert(zl, sptr, (unsigned char *)scorebuf, scorelen);
+        zl = lpInsert(zl, (unsigned char *)scorebuf, scorelen, sptr, LP_AFTER, NULL);
     }
     return zl;
 }
 
-/* Insert (element,score) pair in ziplist. This function assumes the element is
+/* Insert (element,score) pair in listpack. This function assumes the element is
  * not yet present in the list. */
 unsigned char *zzlInsert(unsigned char *zl, sds ele, double score)
 {
-    unsigned char *eptr = ziplistIndex(zl, 0), *sptr;
+    unsigned char *eptr = lpFirst(zl), *sptr;
     double s;
 
     while (eptr != NULL)
     {
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssert(sptr != NULL);
         s = zzlGetScore(sptr);
 
@@ -1332,7 +1328,7 @@ unsigned char *zzlInsert(unsigned char *zl, sds ele, double score)
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl, sptr);
+        eptr = lpNext(zl, sptr);
     }
 
     /* Push on tail of list when it was not yet inserted. */
@@ -1354,16 +1350,15 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec *range, unsig
     if (eptr == NULL)
         return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl, eptr)) != NULL)
+    /* When the tail of the listpack is deleted, lpDelete() sets eptr to NULL. */
+    while (eptr != NULL && (sptr = lpNext(zl, eptr)) != NULL)
     {
         score = zzlGetScore(sptr);
         if (zslValueLteMax(score, range))
         {
             /* Delete both the element and the score. */
-            zl = ziplistDelete(zl, &eptr);
-            zl = ziplistDelete(zl, &eptr);
+            zl = lpDelete(zl, eptr, &eptr);
+            zl = lpDelete(zl, eptr, &eptr);
             num++;
         }
         else
@@ -1390,15 +1385,14 @@ unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsi
     if (eptr == NULL)
         return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl, eptr)) != NULL)
+    /* When the tail of the listpack is deleted, lpDelete() sets eptr to NULL. */
+    while (eptr != NULL && (sptr = lpNext(zl, eptr)) != NULL)
     {
         if (zzlLexValueLteMax(eptr, range))
         {
             /* Delete both the element and the score. */
-            zl = ziplistDelete(zl, &eptr);
-            zl = ziplistDelete(zl, &eptr);
+            zl = lpDelete(zl, eptr, &eptr);
+            zl = lpDelete(zl, eptr, &eptr);
             num++;
         }
         else
@@ -1420,7 +1414,7 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
     unsigned int num = (end - start) + 1;
     if (deleted)
         *deleted = num;
-    zl = ziplistDeleteRange(zl, 2 * (start - 1), 2 * num);
+    zl = lpDeleteRange(zl, 2 * (start - 1), 2 * num);
     return zl;
 }
 
@@ -1431,7 +1425,7 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
 unsigned long zsetLength(const robj *zobj)
 {
     unsigned long length = 0;
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         length = zzlLength(zobj->ptr);
     }
@@ -1455,7 +1449,7 @@ void zsetConvert(robj *zobj, int encoding)
 
     if (zobj->encoding == encoding)
         return;
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
@@ -1470,15 +1464,15 @@ void zsetConvert(robj *zobj, int encoding)
         zs->dict = dictCreate(&zsetDictType, NULL);
         zs->zsl = zslCreate();
 
-        eptr = ziplistIndex(zl, 0);
+        eptr = lpFirst(zl);
         serverAssertWithInfo(NULL, zobj, eptr != NULL);
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssertWithInfo(NULL, zobj, sptr != NULL);
 
         while (eptr != NULL)
         {
             score = zzlGetScore(sptr);
-            serverAssertWithInfo(NULL, zobj, ziplistGet(eptr, &vstr, &vlen, &vlong));
+            vstr = lpGetValue(eptr, &vlen, &vlong);
             if (vstr == NULL)
                 ele = sdsfromlonglong(vlong);
             else
@@ -1495,13 +1489,13 @@ void zsetConvert(robj *zobj, int encoding)
     }
     else if (zobj->encoding == OBJ_ENCODING_SKIPLIST)
     {
-        unsigned char *zl = ziplistNew();
+        unsigned char *zl = lpNew();
 
-        if (encoding != OBJ_ENCODING_ZIPLIST)
+        if (encoding != OBJ_ENCODING_LISTPACK)
             serverPanic("Unknown target encoding");
 
         /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
+         * the same time as creating the listpack. */
         zs = zobj->ptr;
         dictRelease(zs->dict);
         node = zs->zsl->header->level[0].forward;
@@ -1518,7 +1512,7 @@ void zsetConvert(robj *zobj, int encoding)
 
         zfree(zs);
         zobj->ptr = zl;
-        zobj->encoding = OBJ_ENCODING_ZIPLIST;
+        zobj->encoding = OBJ_ENCODING_LISTPACK;
     }
     else
     {
@@ -1526,18 +1520,18 @@ void zsetConvert(robj *zobj, int encoding)
     }
 }
 
-/* Convert the sorted set object into a ziplist if it is not already a ziplist
+/* Convert the sorted set object into a listpack if it is not already a listpack
  * and if the number of elements and the maximum element size is within the
  * expected ranges. */
-void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen)
+void zsetConvertToListpackIfNeeded(robj *zobj, size_t maxelelen)
 {
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
         return;
     zset *zset = zobj->ptr;
 
-    if (zset->zsl->length <= server.zset_max_ziplist_entries &&
-        maxelelen <= server.zset_max_ziplist_value)
-        zsetConvert(zobj, OBJ_ENCODING_ZIPLIST);
+    if (zset->zsl->length <= server.zset_max_listpack_entries &&
+        maxelelen <= server.zset_max_listpack_value)
+        zsetConvert(zobj, OBJ_ENCODING_LISTPACK);
 }
 
 /* Return (by reference) the score of the specified member of the sorted set
@@ -1549,7 +1543,7 @@ int zsetScore(robj *zobj, sds member, double *score)
     if (!zobj || !member)
         return C_ERR;
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         if (zzlFind(zobj->ptr, member, score) == NULL)
             return C_ERR;
@@ -1610,7 +1604,7 @@ int zsetScore(robj *zobj, sds member, double *score)
  * start.
  *
  * The command as a side effect of adding a new element may convert the sorted
- * set internal encoding from ziplist to hashtable+skiplist.
+ * set internal encoding from listpack to hashtable+skiplist.
  *
  * Memory management of 'ele':
  *
@@ -1635,7 +1629,7 @@ int zsetAdd(robj *zobj, double score, sds ele, int *flags, double *newscore)
     }
 
     /* Update the sorted set according to its encoding. */
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *eptr;
 
@@ -1679,8 +1673,8 @@ int zsetAdd(robj *zobj, double score, sds ele, int *flags, double *newscore)
             /* Optimize: check if the element is too large or the list
              * becomes too long *before* executing zzlInsert. */
             zobj->ptr = zzlInsert(zobj->ptr, ele, score);
-            if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries ||
-                sdslen(ele) > server.zset_max_ziplist_value)
+            if (zzlLength(zobj->ptr) > server.zset_max_listpack_entries ||
+                sdslen(ele) > server.zset_max_listpack_value)
                 zsetConvert(zobj, OBJ_ENCODING_SKIPLIST);
             if (newscore)
                 *newscore = score;
@@ -1766,7 +1760,7 @@ int zsetAdd(robj *zobj, double score, sds ele, int *flags, double *newscore)
  * existed and was deleted, 0 otherwise (the element was not there). */
 int zsetDel(robj *zobj, sds ele)
 {
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *eptr;
 
@@ -1829,20 +1823,20 @@ long zsetRank(robj *zobj, sds ele, int reverse)
 
     llen = zsetLength(zobj);
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
-        eptr = ziplistIndex(zl, 0);
+        eptr = lpFirst(zl);
         serverAssert(eptr != NULL);
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssert(sptr != NULL);
 
         rank = 1;
         while (eptr != NULL)
         {
-            if (ziplistCompare(eptr, (unsigned char *)ele, sdslen(ele)))
+            if (lpCompare(eptr, (unsigned char *)ele, sdslen(ele)))
                 break;
             rank++;
             zzlNext(zl, &eptr, &sptr);
@@ -1994,14 +1988,14 @@ void zaddGenericCommand(client *c, int flags)
     {
         if (xx)
             goto reply_to_client; /* No key + XX option: nothing to do. */
-        if (server.zset_max_ziplist_entries == 0 ||
-            server.zset_max_ziplist_value < sdslen(c->argv[scoreidx + 1]->ptr))
+        if (server.zset_max_listpack_entries == 0 ||
+            server.zset_max_listpack_value < sdslen(c->argv[scoreidx + 1]->ptr))
         {
             zobj = createZsetObject();
         }
         else
         {
-            zobj = createZsetZiplistObject();
+            zobj = createZsetListpackObject();
         }
         dbAdd(c->db, key, zobj);
     }
@@ -2161,7 +2155,7 @@ void zremrangeGenericCommand(client *c, int rangetype)
     }
 
     /* Step 3: Perform the range deletion operation. */
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         switch (rangetype)
         {
@@ -2335,13 +2329,13 @@ void zuiInitIterator(zsetopsrc *op)
     else if (op->type == OBJ_ZSET)
     {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == OBJ_ENCODING_ZIPLIST)
+        if (op->encoding == OBJ_ENCODING_LISTPACK)
         {
             it->zl.zl = op->subject->ptr;
-            it->zl.eptr = ziplistIndex(it->zl.zl, 0);
+            it->zl.eptr = lpFirst(it->zl.zl);
             if (it->zl.eptr != NULL)
             {
-                it->zl.sptr = ziplistNext(it->zl.zl, it->zl.eptr);
+                it->zl.sptr = lpNext(it->zl.zl, it->zl.eptr);
                 serverAssert(it->zl.sptr != NULL);
             }
         }
@@ -2385,7 +2379,7 @@ void zuiClearIterator(zsetopsrc *op)
     else if (op->type == OBJ_ZSET)
     {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == OBJ_ENCODING_ZIPLIST)
+        if (op->encoding == OBJ_ENCODING_LISTPACK)
         {
             UNUSED(it); /* skip */
         }
@@ -2427,7 +2421,7 @@ unsigned long zuiLength(zsetopsrc *op)
     }
     else if (op->type == OBJ_ZSET)
     {
-        if (op->encoding == OBJ_ENCODING_ZIPLIST)
+        if (op->encoding == OBJ_ENCODING_LISTPACK)
         {
             return zzlLength(op->subject->ptr);
         }
@@ -2493,12 +2487,12 @@ int zuiNext(zsetopsrc *op, zsetopval *val)
     else if (op->type == OBJ_ZSET)
     {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == OBJ_ENCODING_ZIPLIST)
+        if (op->encoding == OBJ_ENCODING_LISTPACK)
         {
             /* No need to check both, but better be explicit. */
             if (it->zl.eptr == NULL || it->zl.sptr == NULL)
                 return 0;
-            serverAssert(ziplistGet(it->zl.eptr, &val->estr, &val->elen, &val->ell));
+            val->estr = lpGetValue(it->zl.eptr, &val->elen, &val->ell);
             val->score = zzlGetScore(it->zl.sptr);
 
             /* Move to next element. */
@@ -2657,7 +2651,7 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score)
     {
         zuiSdsFromValue(val);
 
-        if (op->encoding == OBJ_ENCODING_ZIPLIST)
+        if (op->encoding == OBJ_ENCODING_LISTPACK)
         {
             if (zzlFind(op->subject->ptr, val->ele, score) != NULL)
             {
@@ -2972,7 +2966,7 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int numkeysIndex, int op
                 {
                     tmp = zuiNewSdsFromValue(&zval);
                     /* Remember the longest single element encountered,
-                     * to understand if it's possible to convert to ziplist
+                     * to understand if it's possible to convert to listpack
                      * at the end. */
                     if (sdslen(tmp) > maxelelen)
                         maxelelen = sdslen(tmp);
@@ -3021,7 +3015,7 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int numkeysIndex, int op
     {
         if (dstzset->zsl->length)
         {
-            zsetConvertToZiplistIfNeeded(dstobj, maxelelen);
+            zsetConvertToListpackIfNeeded(dstobj, maxelelen);
             setKey(c, c->db, dstkey, dstobj);
             addReplyLongLong(c, zsetLength(dstobj));
             notifyKeyspaceEvent(NOTIFY_ZSET,
@@ -3139,7 +3133,7 @@ void zrangeGenericCommand(client *c, int reverse)
     else
         addReplyArrayLen(c, rangelen);
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
@@ -3148,17 +3142,17 @@ void zrangeGenericCommand(client *c, int reverse)
         long long vlong;
 
         if (reverse)
-            eptr = ziplistIndex(zl, -2 - (2 * start));
+            eptr = lpSeek(zl, -2 - (2 * start));
         else
-            eptr = ziplistIndex(zl, 2 * start);
+            eptr = lpSeek(zl, 2 * start);
 
         serverAssertWithInfo(c, zobj, eptr != NULL);
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
 
         while (rangelen--)
         {
             serverAssertWithInfo(c, zobj, eptr != NULL && sptr != NULL);
-            serverAssertWithInfo(c, zobj, ziplistGet(eptr, &vstr, &vlen, &vlong));
+            vstr = lpGetValue(eptr, &vlen, &vlong);
 
             if (withscores && c->resp > 2)
                 addReplyArrayLen(c, 2);
@@ -3294,7 +3288,7 @@ void genericZrangebyscoreCommand(client *c, int reverse)
         checkType(c, zobj, OBJ_ZSET))
         return;
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
@@ -3322,7 +3316,7 @@ void genericZrangebyscoreCommand(client *c, int reverse)
 
         /* Get score pointer for the first element. */
         serverAssertWithInfo(c, zobj, eptr != NULL);
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
 
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
@@ -3359,9 +3353,7 @@ void genericZrangebyscoreCommand(client *c, int reverse)
                     break;
             }
 
-            /* We know the element exists, so ziplistGet should always
-             * succeed */
-            serverAssertWithInfo(c, zobj, ziplistGet(eptr, &vstr, &vlen, &vlong));
+            vstr = lpGetValue(eptr, &vlen, &vlong);
 
             rangelen++;
             if (withscores && c->resp > 2)
@@ -3501,7 +3493,7 @@ void zcountCommand(client *c)
         checkType(c, zobj, OBJ_ZSET))
         return;
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
@@ -3518,7 +3510,7 @@ void zcountCommand(client *c)
         }
 
         /* First element is in range */
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         score = zzlGetScore(sptr);
         serverAssertWithInfo(c, zobj, zslValueLteMax(score, &range));
 
@@ -3596,7 +3588,7 @@ void zlexcountCommand(client *c)
         return;
     }
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
@@ -3613,7 +3605,7 @@ void zlexcountCommand(client *c)
         }
 
         /* First element is in range */
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         serverAssertWithInfo(c, zobj, zzlLexValueLteMax(eptr, &range));
 
         /* Iterate over elements in range */
@@ -3735,7 +3727,7 @@ void genericZrangebylexCommand(client *c, int reverse)
         return;
     }
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK)
     {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
@@ -3763,7 +3755,7 @@ void genericZrangebylexCommand(client *c, int reverse)
 
         /* Get score pointer for the first element. */
         serverAssertWithInfo(c, zobj, eptr != NULL);
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
 
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
@@ -3798,9 +3790,9 @@ void genericZrangebylexCommand(client *c, int reverse)
                     break;
             }
 
-            /* We know the element exists, so ziplistGet should always
+            /* We know the element exists, so lpGetValue should always
              * succeed. */
-            serverAssertWithInfo(c, zobj, ziplistGet(eptr, &vstr, &vlen, &vlong));
+            vstr = lpGetValue(eptr, &vlen, &vlong);
 
             rangelen++;
             if (vstr == NULL)
@@ -4075,7 +4067,7 @@ void genericZpopCommand(client *c, robj **keyv, int keyc, int where, int emitkey
     /* Remove the element. */
     do
     {
-        if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+        if (zobj->encoding == OBJ_ENCODING_LISTPACK)
         {
             unsigned char *zl = zobj->ptr;
             unsigned char *eptr, *sptr;
@@ -4084,16 +4076,16 @@ void genericZpopCommand(client *c, robj **keyv, int keyc, int where, int emitkey
             long long vlong;
 
             /* Get the first or last element in the sorted set. */
-            eptr = ziplistIndex(zl, where == ZSET_MAX ? -2 : 0);
+            eptr = lpSeek(zl, where == ZSET_MAX ? -2 : 0);
             serverAssertWithInfo(c, zobj, eptr != NULL);
-            serverAssertWithInfo(c, zobj, ziplistGet(eptr, &vstr, &vlen, &vlong));
+            vstr = lpGetValue(eptr, &vlen, &vlong);
             if (vstr == NULL)
                 ele = sdsfromlonglong(vlong);
             else
                 ele = sdsnewlen(vstr, vlen);
 
             /* Get the score. */
-            sptr = ziplistNext(zl, eptr);
+            sptr = lpNext(zl, eptr);
             serverAssertWithInfo(c, zobj, sptr != NULL);
             score = zzlGetScore(sptr);
         }
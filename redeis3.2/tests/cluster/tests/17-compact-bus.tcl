@@ -0,0 +1,94 @@
+# Check the compact PING/PONG messages, and that nodes with the compact
+# format disabled still interoperate with the others.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 5 nodes cluster" {
+    create_cluster 5 5
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+test "Cluster is writable" {
+    cluster_write_test 0
+}
+
+test "Compact PING/PONG messages are exchanged" {
+    foreach_redis_id id {
+        wait_for_condition 1000 50 {
+            [CI $id cluster_stats_messages_compact_received] > 0 &&
+            [CI $id cluster_stats_messages_compact_sent] > 0
+        } else {
+            fail "Instance $id is not using compact messages"
+        }
+    }
+}
+
+proc slot_owner {id slot} {
+    foreach range [R $id cluster slots] {
+        lassign $range start end master
+        if {$slot >= $start && $slot <= $end} {
+            return [lindex $master 2]
+        }
+    }
+    return {}
+}
+
+# Move 'slot' to master #'to', and check that every node learns about the
+# new owner from the slots delta in the compact messages.
+proc move_slot_and_check {slot to} {
+    set to_id [dict get [get_myself $to] id]
+    set owner [slot_owner $to $slot]
+    for {set j 0} {$j < 5} {incr j} {
+        if {[dict get [get_myself $j] id] eq $owner} {
+            R $j cluster delslots $slot
+        }
+    }
+    R $to cluster setslot $slot node $to_id
+    R $to cluster bumpepoch
+    foreach_redis_id id {
+        wait_for_condition 1000 50 {
+            [slot_owner $id $slot] eq $to_id
+        } else {
+            fail "Instance $id didn't learn the new owner of slot $slot"
+        }
+    }
+}
+
+test "Slots ownership changes are propagated" {
+    move_slot_and_check 0 1
+}
+
+test "Nodes with the compact format disabled receive full messages" {
+    R 2 config set cluster-compact-bus no
+    # Wait for the other nodes to notice, then for the messages in flight.
+    after 3000
+    set received [CI 2 cluster_stats_messages_compact_received]
+    set sent [CI 2 cluster_stats_messages_compact_sent]
+    after 3000
+    assert_equal $received [CI 2 cluster_stats_messages_compact_received]
+    assert_equal $sent [CI 2 cluster_stats_messages_compact_sent]
+    assert {[CI 2 cluster_stats_messages_pong_received] > 0}
+}
+
+test "Slots ownership changes are propagated with mixed formats" {
+    move_slot_and_check 0 2
+    move_slot_and_check 1 0
+}
+
+test "Cluster is still up and writable" {
+    assert_cluster_state ok
+    cluster_write_test 0
+}
+
+test "Compact messages are used again once enabled" {
+    R 2 config set cluster-compact-bus yes
+    set received [CI 2 cluster_stats_messages_compact_received]
+    wait_for_condition 1000 50 {
+        [CI 2 cluster_stats_messages_compact_received] > $received
+    } else {
+        fail "Instance #2 is not receiving compact messages"
+    }
+}
@@ -0,0 +1,46 @@
+# Check ASYNCMIGRATE moving the keys of a slot between two masters.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 2 nodes cluster" {
+    create_cluster 2 0
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+test "ASYNCMIGRATE rejects invalid slots" {
+    catch {R 0 asyncmigrate start 127.0.0.1 1 0 1000 slots 0 99999} e
+    assert_match {*Invalid or out of range slot*} $e
+    catch {R 0 asyncmigrate start 127.0.0.1 1 0 1000 slots foo} e
+    assert_match {*Invalid or out of range slot*} $e
+    assert_equal none [dict get [R 0 asyncmigrate status] state]
+    assert_equal PONG [R 0 ping]
+}
+
+test "ASYNCMIGRATE moves the keys of a slot" {
+    # Keys with the {06S} hash tag belong to slot 0: move them from the
+    # master serving it to the other one.
+    assert_equal 0 [R 0 cluster keyslot {06S}]
+    set src [expr {[catch {R 0 set "{06S}key:0" 0}] ? 1 : 0}]
+    set dst [expr {1-$src}]
+    for {set j 0} {$j < 1000} {incr j} {
+        R $src set "{06S}key:$j" $j
+    }
+    R $dst cluster setslot 0 importing [R $src cluster myid]
+    R $src cluster setslot 0 migrating [R $dst cluster myid]
+    R $src asyncmigrate start 127.0.0.1 [get_instance_attrib redis $dst port] \
+        0 5000 window 1000 slots 0
+    wait_for_condition 100 50 {
+        [dict get [R $src asyncmigrate status] state] eq {done}
+    } else {
+        fail "ASYNCMIGRATE did not complete: [R $src asyncmigrate status]"
+    }
+    assert_equal 1000 [dict get [R $src asyncmigrate status] keys-migrated]
+    assert_equal 0 [R $src cluster countkeysinslot 0]
+    assert_equal 1000 [R $dst cluster countkeysinslot 0]
+    R $src cluster setslot 0 node [R $dst cluster myid]
+    R $dst cluster setslot 0 node [R $dst cluster myid]
+    assert_equal 999 [R $dst get "{06S}key:999"]
+}
@@ -0,0 +1,107 @@
+# Check the per slot key count and memory accounting of CLUSTER SLOT-STATS.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 1 node cluster" {
+    create_cluster 1 0
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+proc slot_stats {id slot} {
+    set reply [R $id cluster slot-stats slotsrange $slot $slot]
+    assert_equal $slot [lindex $reply 0 0]
+    return [lindex $reply 0 1]
+}
+
+test "Keys are counted in their slot" {
+    R 0 flushall
+    assert_equal {0 0} [dict values [slot_stats 0 0]]
+    for {set j 0} {$j < 100} {incr j} {
+        R 0 set "{06S}key:$j" $j
+    }
+    R 0 del "{06S}key:0"
+    R 0 unlink "{06S}key:1"
+    R 0 set "{06S}key:2" 0 px 1
+    after 10
+    R 0 get "{06S}key:2"
+    set stats [slot_stats 0 0]
+    assert_equal 97 [dict get $stats key-count]
+    assert_equal 97 [R 0 cluster countkeysinslot 0]
+    assert_equal 10 [llength [R 0 cluster getkeysinslot 0 10]]
+    assert_equal 97 [llength [R 0 cluster getkeysinslot 0 1000]]
+    assert {[dict get $stats memory-bytes] > 0}
+}
+
+test "Slot memory follows the size of the values" {
+    R 0 flushall
+    R 0 set "{06S}big" [string repeat x 10000]
+    set big [dict get [slot_stats 0 0] memory-bytes]
+    assert {$big > 10000}
+    R 0 set "{06S}big" small
+    assert {[dict get [slot_stats 0 0] memory-bytes] < 1000}
+    for {set j 0} {$j < 100} {incr j} {
+        R 0 rpush "{06S}list" [string repeat x 100]
+    }
+    assert {[dict get [slot_stats 0 0] memory-bytes] > 10000}
+    R 0 del "{06S}list" "{06S}big"
+    assert_equal {0 0} [dict values [slot_stats 0 0]]
+}
+
+test "ORDERBY returns the largest slots first" {
+    R 0 flushall
+    # {06S} is slot 0, {Qi} is slot 1, {5L5} is slot 2.
+    for {set j 0} {$j < 10} {incr j} {
+        R 0 set "{06S}key:$j" x
+        R 0 set "{Qi}key:$j" x
+    }
+    R 0 set "{Qi}key:10" x
+    R 0 set "{5L5}key" [string repeat x 100000]
+
+    set reply [R 0 cluster slot-stats orderby key-count limit 3]
+    assert_equal {1 0 2} [list [lindex $reply 0 0] [lindex $reply 1 0] \
+                               [lindex $reply 2 0]]
+    assert_equal 11 [dict get [lindex $reply 0 1] key-count]
+
+    set reply [R 0 cluster slot-stats orderby memory-bytes limit 1]
+    assert_equal 2 [lindex $reply 0 0]
+
+    # Slots with the same value are sorted by slot.
+    set reply [R 0 cluster slot-stats orderby key-count limit 2 asc]
+    assert_equal {3 4} [list [lindex $reply 0 0] [lindex $reply 1 0]]
+    assert_equal 16 [llength [R 0 cluster slot-stats orderby key-count]]
+}
+
+test "SLOT-STATS errors" {
+    catch {R 0 cluster slot-stats slotsrange 10 5} e
+    assert_match {*greater than*} $e
+    catch {R 0 cluster slot-stats slotsrange 0 16384} e
+    assert_match {*out of range*} $e
+    catch {R 0 cluster slot-stats orderby foo} e
+    assert_match {*Unrecognized sort metric*} $e
+    catch {R 0 cluster slot-stats orderby key-count limit 0} e
+    assert_match {*Limit*} $e
+}
+
+test "Slot lists survive DEBUG RELOAD and FLUSHALL ASYNC" {
+    R 0 flushall
+    for {set j 0} {$j < 1000} {incr j} {
+        R 0 set "key:$j" $j
+    }
+    R 0 debug reload
+    set total 0
+    foreach item [R 0 cluster slot-stats slotsrange 0 16383] {
+        incr total [dict get [lindex $item 1] key-count]
+    }
+    assert_equal 1000 $total
+    set slot [R 0 cluster keyslot key:0]
+    assert_equal [R 0 cluster countkeysinslot $slot] \
+                 [llength [R 0 cluster getkeysinslot $slot 1000]]
+    R 0 flushall async
+    assert_equal 0 [R 0 cluster countkeysinslot $slot]
+    assert_equal {} [R 0 cluster getkeysinslot $slot 10]
+    R 0 set key:0 0
+    assert_equal key:0 [R 0 cluster getkeysinslot $slot 10]
+}
@@ -21,6 +21,17 @@ start_server [list overrides [list "dir" $server_path "dbfilename" "encodings.rd
 "0","zset","zset","a","1","b","2","c","3","aa","10","bb","20","cc","30","aaa","100","bbb","200","ccc","300","aaaa","1000","cccc","123456789","bbbb","5000000000",
 "0","zset_zipped","zset","a","1","b","2","c","3",
 }
+
+  test "RDB load ziplist hash and zset: converts to listpack" {
+    r select 0
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    r debug reload
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    assert_equal {a 1 b 2 c 3} [r hgetall hash_zipped]
+    assert_equal {a 1 b 2 c 3} [r zrange zset_zipped 0 -1 withscores]
+  }
 }
 
 set server_path [tmpdir "server.rdb-startup-test"]
@@ -134,10 +134,10 @@ start_server {tags {"aofrw"} overrides {aof-use-rdb-preamble no}} {
     }
 
     foreach d {string int} {
-        foreach e {ziplist hashtable} {
+        foreach e {listpack hashtable} {
             test "AOF rewrite of hash with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -160,10 +160,10 @@ start_server {tags {"aofrw"} overrides {aof-use-rdb-preamble no}} {
     }
 
     foreach d {string int} {
-        foreach e {ziplist skiplist} {
+        foreach e {listpack skiplist} {
             test "AOF rewrite of zset with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -376,4 +376,114 @@ start_server {tags {"dump"}} {
             assert_match {*WRONGPASS*} $err
         }
     }
+
+    proc wait_for_async_migrate {r state} {
+        wait_for_condition 100 50 {
+            [lsearch {running connecting} \
+                [dict get [$r asyncmigrate status] state]] == -1
+        } else {
+            fail "ASYNCMIGRATE did not terminate"
+        }
+        set status [$r asyncmigrate status]
+        if {[dict get $status state] ne $state} {
+            fail "ASYNCMIGRATE $status"
+        }
+    }
+
+    test {ASYNCMIGRATE pipelines many keys with flow control} {
+        set first [srv 0 client]
+        r flushall
+        set keys {}
+        for {set j 0} {$j < 1000} {incr j} {
+            r set key:$j [string repeat x $j]
+            lappend keys key:$j
+        }
+        r expire key:0 100
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            set ret [r -1 asyncmigrate start $second_host $second_port 9 5000 \
+                window 10000 keys {*}$keys nokey]
+            assert_equal OK $ret
+            wait_for_async_migrate $first done
+            set status [$first asyncmigrate status]
+            assert_equal 1000 [dict get $status keys-migrated]
+            assert_equal 0 [dict get $status keys-in-flight]
+            assert_equal [dict get $status bytes-sent] \
+                         [dict get $status bytes-acked]
+            assert_equal 0 [$first dbsize]
+            assert_equal 1000 [$second dbsize]
+            assert_equal [string repeat x 999] [$second get key:999]
+            assert_range [$second ttl key:0] 90 100
+            assert_equal -1 [$second ttl key:1]
+            assert_equal 1000 [s -1 async_migrate_keys]
+        }
+    }
+
+    test {ASYNCMIGRATE stops on target errors, keeping the keys} {
+        set first [srv 0 client]
+        r flushall
+        r set a 1
+        r set b 2
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            $second set b 3
+            r -1 asyncmigrate start $second_host $second_port 9 5000 keys a b
+            wait_for_async_migrate $first failed
+            assert_match {*BUSYKEY*} \
+                [dict get [$first asyncmigrate status] last-error]
+            assert_equal 0 [$first exists a]
+            assert_equal 2 [$first get b]
+            assert_equal 3 [$second get b]
+
+            r -1 asyncmigrate start $second_host $second_port 9 5000 \
+                replace keys b
+            wait_for_async_migrate $first done
+            assert_equal 0 [$first exists b]
+            assert_equal 2 [$second get b]
+        }
+    }
+
+    test {ASYNCMIGRATE sends again keys modified while in flight} {
+        set first [srv 0 client]
+        r flushall
+        r set a old
+        r set b old
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            # Delay the replies of the target, so that the keys are
+            # modified before they are acknowledged.
+            set rd [redis_deferring_client]
+            $rd debug sleep 1
+            after 100
+            r -1 asyncmigrate start $second_host $second_port 9 5000 keys a b
+            after 100
+            assert_equal running [dict get [$first asyncmigrate status] state]
+            $first set a new
+            $first del b
+            wait_for_async_migrate $first done
+            $rd read
+            $rd close
+            assert_equal 0 [$first dbsize]
+            assert_equal new [$second get a]
+            assert_equal 0 [$second exists b]
+        }
+    }
+
+    test {ASYNCMIGRATE errors} {
+        catch {r asyncmigrate start 127.0.0.1 1 0 1000 slots 0} e
+        assert_match {*cluster support*} $e
+        catch {r asyncmigrate start 127.0.0.1 1 0 1000 replace window} e
+        assert_match {*syntax*} $e
+        catch {r asyncmigrate cancel} e
+        assert_match {*No asynchronous migration*} $e
+    }
 }
@@ -381,6 +381,96 @@ start_server {tags {"defrag"} overrides {appendonly yes auto-aof-rewrite-percent
             r del biglist1 ;# coverage for quicklistBookmarksClear
         } {1}
 
+        test "Active defrag with threaded scan" {
+            r flushdb
+            r config resetstat
+            r config set hz 100
+            r config set activedefrag no
+            r config set active-defrag-threaded yes
+            r config set active-defrag-max-scan-fields 1000
+            r config set active-defrag-threshold-lower 5
+            r config set active-defrag-cycle-min 65
+            r config set active-defrag-cycle-max 75
+            r config set active-defrag-ignore-bytes 2mb
+            r config set maxmemory 0
+
+            set rd [redis_deferring_client]
+            r hmset hash h1 v1 h2 v2 h3 v3
+            r zadd zset 0 a 1 b 2 c 3 d
+            for {set j 0} {$j < 500000} {incr j} {
+                $rd setrange $j 150 a
+            }
+            for {set j 0} {$j < 500000} {incr j} {
+                $rd read ; # Discard replies
+            }
+
+            # create some fragmentation
+            for {set j 0} {$j < 500000} {incr j 2} {
+                $rd del $j
+            }
+            for {set j 0} {$j < 500000} {incr j 2} {
+                $rd read ; # Discard replies
+            }
+
+            after 120 ;# serverCron only updates the info once in 100ms
+            set frag [s allocator_frag_ratio]
+            if {$::verbose} {
+                puts "frag $frag"
+            }
+            assert {$frag >= 1.4}
+            r config set latency-monitor-threshold 5
+            r latency reset
+
+            set digest [r debug digest]
+            catch {r config set activedefrag yes} e
+            if {![string match {DISABLED*} $e]} {
+                # wait for the active defrag to start working (decision once a second)
+                wait_for_condition 50 100 {
+                    [s active_defrag_running] ne 0
+                } else {
+                    fail "defrag not started."
+                }
+
+                # wait for the active defrag to stop working
+                wait_for_condition 500 100 {
+                    [s active_defrag_running] eq 0
+                } else {
+                    after 120 ;# serverCron only updates the info once in 100ms
+                    puts [r info memory]
+                    puts [r info stats]
+                    fail "defrag didn't stop."
+                }
+
+                after 120 ;# serverCron only updates the info once in 100ms
+                set frag [s allocator_frag_ratio]
+                set max_latency 0
+                foreach event [r latency latest] {
+                    lassign $event eventname time latency max
+                    if {$eventname == "active-defrag-cycle"} {
+                        set max_latency $max
+                    }
+                }
+                if {$::verbose} {
+                    puts "frag $frag"
+                    puts "hits: [s active_defrag_hits]"
+                    puts "bytes: [s active_defrag_bytes]"
+                    puts "max latency $max_latency"
+                }
+                assert {$frag < 1.1}
+                assert {[s active_defrag_bytes] > 0}
+                assert {$max_latency <= 30}
+                # The keys were found by the scan thread.
+                assert {[s active_defrag_candidates] > 0}
+                assert {[s active_defrag_pending_keys] == 0}
+                assert {[s active_defrag_key_hits] > 0}
+            }
+            r config set active-defrag-threaded no
+            # verify the data isn't corrupted or changed
+            set newdigest [r debug digest]
+            assert {$digest eq $newdigest}
+            r save ;# saving an rdb iterates over all the data / pointers
+        } {OK}
+
         test "Active defrag edge case" {
             # there was an edge case in defrag where all the slabs of a certain bin are exact the same
             # % utilization, with the exception of the current slab from which new allocations are made
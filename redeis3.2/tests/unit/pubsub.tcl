@@ -213,6 +213,92 @@ start_server {tags {"pubsub"}} {
         $rd1 close
     }
 
+    test "PUBLISH/PSUBSCRIBE with patterns sharing literal prefixes" {
+        set rd1 [redis_deferring_client]
+        set patterns {* f* fo* foo.* foo.b?r foo.\\* {f[ox]o.bar} foo.bar
+                      foo.barx *.bar ?oo.* bar.*}
+        psubscribe $rd1 $patterns
+        foreach channel {foo.bar foo.* foox.bar f fo foo. bar.foo} {
+            set expected {}
+            foreach pat $patterns {
+                if {[string match $pat $channel]} {
+                    lappend expected [list pmessage $pat $channel hello]
+                }
+            }
+            assert_equal [llength $expected] [r publish $channel hello]
+            set got {}
+            foreach _ $expected {lappend got [$rd1 read]}
+            assert_equal [lsort $expected] [lsort $got]
+        }
+
+        # Removing patterns removes them from the index as well.
+        punsubscribe $rd1 {* f* foo.*}
+        assert_equal 6 [r publish foo.bar hello]
+        for {set j 0} {$j < 6} {incr j} {$rd1 read}
+        punsubscribe $rd1
+        assert_equal 0 [r publish foo.bar hello]
+        assert_equal 0 [r pubsub numpat]
+
+        # clean up clients
+        $rd1 close
+    }
+
+    test "PUBLISH/PSUBSCRIBE with long literal prefixes" {
+        set rd1 [redis_deferring_client]
+        set long [string repeat abcdefghij 100]
+        set patterns [list a* $long* [string range $long 0 499]x* \
+                      [string range $long 0 498]*]
+        psubscribe $rd1 $patterns
+        foreach channel [list $long$long $long [string range $long 0 499]x \
+                             [string range $long 0 700]z a b] {
+            set expected {}
+            foreach pat $patterns {
+                if {[string match $pat $channel]} {
+                    lappend expected [list pmessage $pat $channel hello]
+                }
+            }
+            assert_equal [llength $expected] [r publish $channel hello]
+            set got {}
+            foreach _ $expected {lappend got [$rd1 read]}
+            assert_equal [lsort $expected] [lsort $got]
+        }
+        punsubscribe $rd1
+        $rd1 close
+    }
+
+    test "PUBLISH to RESP2 and RESP3 subscribers" {
+        set rd1 [redis_deferring_client]
+        subscribe $rd1 {chan}
+        psubscribe $rd1 {ch*}
+        set fd [socket [srv 0 host] [srv 0 port]]
+        fconfigure $fd -translation binary
+        puts -nonewline $fd "HELLO 3\r\nSUBSCRIBE chan\r\nPSUBSCRIBE ch*\r\n"
+        flush $fd
+        wait_for_condition 50 100 {
+            [llength [r pubsub numsub chan]] == 2 &&
+            [lindex [r pubsub numsub chan] 1] == 2 &&
+            [r pubsub numpat] == 2
+        } else {
+            fail "RESP3 client not subscribed"
+        }
+        assert_equal 4 [r publish chan hello]
+        assert_equal {message chan hello} [$rd1 read]
+        assert_equal {pmessage ch* chan hello} [$rd1 read]
+
+        set expected ">3\r\n\$7\r\nmessage\r\n\$4\r\nchan\r\n\$5\r\nhello\r\n"
+        append expected ">4\r\n\$8\r\npmessage\r\n\$3\r\nch*\r\n"
+        append expected "\$4\r\nchan\r\n\$5\r\nhello\r\n"
+        fconfigure $fd -blocking 0
+        set buf {}
+        wait_for_condition 50 100 {
+            [string first $expected [append buf [read $fd]]] != -1
+        } else {
+            fail "RESP3 push messages not received: $buf"
+        }
+        close $fd
+        $rd1 close
+    }
+
     test "PUNSUBSCRIBE and UNSUBSCRIBE should always reply" {
         # Make sure we are not subscribed to any channel at all.
         r punsubscribe
@@ -388,3 +474,41 @@ start_server {tags {"pubsub"}} {
         assert_equal {AE} [lindex [r config get notify-keyspace-events] 1]
     }
 }
+
+start_server {tags {"pubsub"} overrides {io-threads 2}} {
+    test "PUBLISH to many subscribers using the I/O threads" {
+        # Enough subscribers for the I/O threads to perform the fan-out.
+        set fds {}
+        for {set j 0} {$j < 1000} {incr j} {
+            set fd [socket [srv 0 host] [srv 0 port]]
+            fconfigure $fd -translation binary
+            puts -nonewline $fd "SUBSCRIBE bigchan\r\n"
+            flush $fd
+            lappend fds $fd
+        }
+        set subscribed "*3\r\n\$9\r\nsubscribe\r\n\$7\r\nbigchan\r\n:1\r\n"
+        foreach fd $fds {
+            assert_equal $subscribed [read $fd [string length $subscribed]]
+        }
+
+        assert_equal 1000 [r publish bigchan hello]
+        assert_equal 1000 [r publish bigchan world]
+        foreach msg {hello world} {
+            set expected "*3\r\n\$7\r\nmessage\r\n\$7\r\nbigchan\r\n"
+            append expected "\$5\r\n$msg\r\n"
+            foreach fd $fds {
+                assert_equal $expected [read $fd [string length $expected]]
+            }
+        }
+
+        # Output buffer limits are still enforced.
+        r config set client-output-buffer-limit "pubsub 1k 0 0"
+        r publish bigchan [string repeat x 20000]
+        wait_for_condition 50 100 {
+            [lindex [r pubsub numsub bigchan] 1] == 0
+        } else {
+            fail "Subscribers over the output buffer limit were not closed"
+        }
+        foreach fd $fds {close $fd}
+    }
+}
@@ -311,6 +311,88 @@ start_server {tags {"scripting"}} {
             [r evalsha b534286061d4b9e4026607613b95c06c06015ae8 0]
     } {b534286061d4b9e4026607613b95c06c06015ae8 loaded}
 
+    test {EVAL - Large replies are converted to Lua values correctly} {
+        r del myhash mylist
+        for {set j 0} {$j < 1000} {incr j} {
+            r hset myhash field:$j [string repeat v $j]
+            r rpush mylist $j [string repeat x $j]
+        }
+        assert_equal [r hgetall myhash] \
+            [r eval {return redis.call('hgetall',KEYS[1])} 1 myhash]
+        assert_equal [r lrange mylist 0 -1] \
+            [r eval {return redis.call('lrange',KEYS[1],0,-1)} 1 mylist]
+    }
+
+    test {EVAL - Replies emitted in parts are converted to Lua values} {
+        r set mycounter 100
+        r eval {
+            local t = {}
+            t[1] = redis.call('incr',KEYS[1])
+            t[2] = type(redis.call('incrbyfloat',KEYS[1],1.5))
+            t[3] = redis.pcall('incr',KEYS[1])['err']
+            return t
+        } 1 mycounter
+    } {101 string {ERR value is not an integer or out of range}}
+
+    test {EVAL - Nested and deferred length replies to Lua conversion} {
+        r del mystream
+        r xadd mystream 1-1 a 1 b 2
+        r xadd mystream 2-1 c 3
+        r eval {
+            local t = redis.call('xrange',KEYS[1],'-','+')
+            return {t[1][1], t[1][2][4], t[2][2][1], #redis.call('keys','mystr*')}
+        } 1 mystream
+    } {1-1 2 c 1}
+
+    test {EVAL - RESP3 maps and sets to Lua conversion} {
+        r del myhash myset myset2 mystream
+        r hset myhash a 1 b 2
+        r sadd myset x y
+        r sadd myset2 y z
+        r xadd mystream 1-1 a 1
+        r eval {
+            redis.setresp(3)
+            local h = redis.call('hgetall',KEYS[1])['map']
+            local s = redis.call('smembers',KEYS[2])['set']
+            local i = redis.call('sinter',KEYS[2],KEYS[3])['set']
+            local x = redis.call('xread','streams',KEYS[4],0)['map']
+            return {h['a'], h['b'], tostring(s['x']), tostring(i['y']),
+                    tostring(i['x']), x['mystream'][1][1],
+                    type(redis.call('get','nokey'))}
+        } 4 myhash myset myset2 mystream
+    } {1 2 true true nil 1-1 nil}
+
+    test {EVAL - RESP3 replies are the same Lua values in the debugger} {
+        # While the debugger steps through a script, redis.call() replies
+        # are converted from the protocol text instead of directly.
+        r del myhash myset myzset mystream
+        r hset myhash a 1 b 2
+        r sadd myset x y
+        r zadd myzset 1.5 m
+        r xadd mystream 1-1 a 1
+        foreach script {
+            {redis.setresp(3); return redis.call('hgetall',KEYS[1])}
+            {redis.setresp(3); return redis.call('smembers',KEYS[1])}
+            {redis.setresp(3); return redis.call('zscore',KEYS[1],'m')}
+            {redis.setresp(3); return redis.call('xread','streams',KEYS[1],0)}
+            {redis.setresp(3); return redis.pcall('incr',KEYS[1])}
+            {redis.setresp(3); return {redis.call('ping'), type(redis.call('get',KEYS[1]))}}
+            {redis.setresp(3); local v = redis.call('lolwut'); return {type(v), string.sub(v,1,4) == 'txt:'}}
+        } key {myhash myset myzset mystream myhash nokey nokey} {
+            catch {r eval $script 1 $key} direct
+            set rd [redis_deferring_client]
+            $rd script debug sync
+            $rd read
+            $rd eval $script 1 $key
+            $rd read ;# Stopped at the first line.
+            $rd s
+            $rd read ;# Commands log and end of the session.
+            catch {$rd read} debugged
+            $rd close
+            assert_equal $direct $debugged
+        }
+    }
+
     test "In the context of Lua the output of random commands gets ordered" {
         r debug lua-always-replicate-commands 0
         r del myset
@@ -796,3 +878,32 @@ start_server {tags {"scripting"}} {
     r eval {return 'hello'} 0
     r eval {return 'hello'} 0
 }
+
+start_server {tags {"scripting"}} {
+    test {Script cache is persisted in the RDB file and compiled lazily} {
+        set sha [r script load "return 'persisted'"]
+        r save
+        restart_server 0 true
+        assert_equal 1 [lindex [r script exists $sha] 0]
+        assert_equal 0 [s lua_script_compilations]
+        assert_equal persisted [r evalsha $sha 0]
+        assert_equal persisted [r evalsha $sha 0]
+        assert_equal 1 [s lua_script_compilations]
+        assert_equal 1 [s lua_script_cache_misses]
+        assert_equal 1 [s lua_script_cache_hits]
+
+        # Unknown scripts are not cache misses: nothing gets compiled.
+        catch {r evalsha ffffffffffffffffffffffffffffffffffffffff 0}
+        assert_equal 1 [s lua_script_cache_misses]
+    }
+
+    test {Script cache is not persisted with lua-script-cache-persist no} {
+        r config set lua-script-cache-persist no
+        r script flush
+        set sha [r script load "return 'persisted'"]
+        r save
+        restart_server 0 true
+        catch {r evalsha $sha 0} e
+        set e
+    } {NOSCRIPT*}
+}
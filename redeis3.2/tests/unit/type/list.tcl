@@ -947,6 +947,31 @@ start_server {
         assert_equal {} [r lrange nosuchkey 0 1]
     }
 
+    foreach depth {0 1} {
+        test "LRANGE across many nodes with list-compress-depth $depth" {
+            r config set list-compress-depth $depth
+            r del mylist
+            set expected {}
+            for {set j 0} {$j < 1000} {incr j} {
+                # Mix integer encoded, small and big (> reply chunk) values.
+                if {$j % 100 == 0} {
+                    set v [string repeat x 20000]
+                } elseif {$j % 3 == 0} {
+                    set v $j
+                } else {
+                    set v "value:$j"
+                }
+                r rpush mylist $v
+                lappend expected $v
+            }
+            assert_equal $expected [r lrange mylist 0 -1]
+            assert_equal [lrange $expected 17 923] [r lrange mylist 17 923]
+            assert_equal [lrange $expected end-9 end] [r lrange mylist -10 -1]
+            assert_equal $expected [r lrange mylist 0 -1]
+            r config set list-compress-depth 0
+        }
+    }
+
     foreach {type large} [array get largevalue] {
         proc trim_list {type min max} {
             upvar 1 large large
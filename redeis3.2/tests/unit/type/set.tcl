@@ -276,6 +276,69 @@ start_server {
         }
     }
 
+    test "SINTER, SUNION and SDIFF fuzzing with intsets" {
+        for {set j 0} {$j < 100} {incr j} {
+            unset -nocomplain elements
+            set args {}
+            set num_sets [expr {[randomInt 4]+2}]
+            for {set i 0} {$i < $num_sets} {incr i} {
+                # Sets of very different sizes and encodings, so that both
+                # the merge and the galloping code paths are exercised.
+                set num_elements [lindex {0 1 10 100 500} [randomInt 5]]
+                set range [lindex {1000 100000 10000000000} [randomInt 3]]
+                r del set_$i
+                lappend args set_$i
+                set elements($i) {}
+                for {set k 0} {$k < $num_elements} {incr k} {
+                    set ele [expr {[randomInt $range]-$range/2}]
+                    r sadd set_$i $ele
+                    lappend elements($i) $ele
+                }
+                set elements($i) [lsort -unique $elements($i)]
+                if {[llength $elements($i)]} {assert_encoding intset set_$i}
+            }
+
+            set inter $elements(0)
+            set union $elements(0)
+            set diff $elements(0)
+            for {set i 1} {$i < $num_sets} {incr i} {
+                set next {}
+                foreach ele $inter {
+                    if {[lsearch -exact $elements($i) $ele] != -1} {
+                        lappend next $ele
+                    }
+                }
+                set inter $next
+                set union [lsort -unique [concat $union $elements($i)]]
+                set next {}
+                foreach ele $diff {
+                    if {[lsearch -exact $elements($i) $ele] == -1} {
+                        lappend next $ele
+                    }
+                }
+                set diff $next
+            }
+            assert_equal [lsort $inter] [lsort [r sinter {*}$args]]
+            assert_equal [lsort $union] [lsort [r sunion {*}$args]]
+            assert_equal [lsort $diff] [lsort [r sdiff {*}$args]]
+            assert_equal [llength $union] [r sunionstore setres {*}$args]
+            assert_equal [lsort $union] [lsort [r smembers setres]]
+        }
+    }
+
+    test "SUNIONSTORE of intsets exceeding set-max-intset-entries" {
+        r del set1 set2 setres
+        for {set i 0} {$i < 300} {incr i} {
+            r sadd set1 $i
+            r sadd set2 [expr {$i+300}]
+        }
+        assert_encoding intset set1
+        assert_equal 600 [r sunionstore setres set1 set2]
+        assert_encoding hashtable setres
+        assert_equal 300 [r sdiffstore setres set1 set2]
+        assert_encoding intset setres
+    }
+
     test "SINTER against non-set should throw error" {
         r set key1 x
         assert_error "WRONGTYPE*" {r sinter key1 noset}
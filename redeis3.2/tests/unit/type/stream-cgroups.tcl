@@ -70,6 +70,91 @@ start_server {
         assert {[llength $pending] == 2}
     }
 
+    test {XPENDING with IDLE} {
+        r del idlestream
+        r XGROUP CREATE idlestream mygroup $ MKSTREAM
+        set id1 [r XADD idlestream * a 1]
+        set id2 [r XADD idlestream * b 2]
+        set id3 [r XADD idlestream * c 3]
+        r XREADGROUP GROUP mygroup consumer-1 STREAMS idlestream ">"
+        # Make the most recent entry the least recently delivered one.
+        r XCLAIM idlestream mygroup consumer-2 0 $id3 IDLE 10000
+        r XCLAIM idlestream mygroup consumer-2 0 $id1 IDLE 5000
+        set pending [r XPENDING idlestream mygroup IDLE 1000 - + 10]
+        assert_equal 2 [llength $pending]
+        assert_equal $id3 [lindex $pending 0 0]
+        assert_equal $id1 [lindex $pending 1 0]
+        assert_equal consumer-2 [lindex $pending 0 1]
+        assert {[lindex $pending 0 2] >= 10000}
+
+        # Range, count and consumer filters still apply.
+        assert_equal 1 [llength [r XPENDING idlestream mygroup IDLE 1000 - + 1]]
+        set pending [r XPENDING idlestream mygroup IDLE 1000 - $id2 10]
+        assert_equal $id1 [lindex $pending 0 0]
+        assert_equal {} [r XPENDING idlestream mygroup IDLE 1000 - + 10 consumer-1]
+        set pending [r XPENDING idlestream mygroup IDLE 0 - + 10 consumer-1]
+        assert_equal $id2 [lindex $pending 0 0]
+
+        # Acknowledged entries leave the time index as well.
+        r XACK idlestream mygroup $id3
+        set pending [r XPENDING idlestream mygroup IDLE 1000 - + 10]
+        assert_equal 1 [llength $pending]
+        assert_equal $id1 [lindex $pending 0 0]
+
+        assert_error "*syntax*" {r XPENDING idlestream mygroup IDLE 1000 - +}
+        assert_error "*not an integer*" {r XPENDING idlestream mygroup IDLE foo - + 10}
+    }
+
+    test {XPENDING with IDLE after DEBUG RELOAD} {
+        r DEBUG RELOAD
+        set pending [r XPENDING idlestream mygroup IDLE 1000 - + 10]
+        assert_equal 1 [llength $pending]
+        assert_equal $id1 [lindex $pending 0 0]
+        assert_equal 2 [llength [r XPENDING idlestream mygroup IDLE 0 - + 10]]
+        assert {[r MEMORY USAGE idlestream] > 0}
+    }
+
+    test {XPENDING with IDLE on a large PEL} {
+        r del idlestream
+        r XGROUP CREATE idlestream mygroup $ MKSTREAM
+        for {set j 0} {$j < 500} {incr j} {r XADD idlestream * f $j}
+        r XREADGROUP GROUP mygroup consumer-1 STREAMS idlestream ">"
+        set pending [r XPENDING idlestream mygroup - + 500]
+        for {set j 0} {$j < 500} {incr j 2} {
+            r XACK idlestream mygroup [lindex $pending $j 0]
+        }
+        assert_equal 250 [llength [r XPENDING idlestream mygroup IDLE 0 - + 1000]]
+        r XGROUP DELCONSUMER idlestream mygroup consumer-1
+        assert_equal {} [r XPENDING idlestream mygroup IDLE 0 - + 1000]
+        r XADD idlestream * f x
+        r XREADGROUP GROUP mygroup consumer-1 STREAMS idlestream ">"
+        assert_equal 1 [llength [r XPENDING idlestream mygroup IDLE 0 - + 10]]
+    }
+
+    test {PEL memory is released when the PEL shrinks} {
+        r del nackstream
+        r XGROUP CREATE nackstream mygroup $ MKSTREAM
+        r XADD nackstream * f 0
+        set empty [r MEMORY USAGE nackstream]
+        r XREADGROUP GROUP mygroup consumer-1 STREAMS nackstream ">"
+        set one [r MEMORY USAGE nackstream]
+        # A single pending entry (with its consumer and PEL trees) doesn't
+        # allocate a big chunk of NACKs.
+        assert {$one - $empty < 2048}
+
+        for {set j 1} {$j < 2000} {incr j} {r XADD nackstream * f $j}
+        r XREADGROUP GROUP mygroup consumer-1 STREAMS nackstream ">"
+        set pending [r XPENDING nackstream mygroup - + 2000]
+        set big [r MEMORY USAGE nackstream]
+        for {set j 0} {$j < 1990} {incr j} {
+            r XACK nackstream mygroup [lindex $pending $j 0]
+        }
+        set small [r MEMORY USAGE nackstream]
+        assert {$big - $small > 1990*24}
+        assert_equal 10 [llength [r XPENDING nackstream mygroup - + 2000]]
+        assert_equal 10 [llength [r XPENDING nackstream mygroup IDLE 0 - + 2000]]
+    }
+
     test {XACK is able to remove items from the client/group PEL} {
         set pending [r XPENDING mystream mygroup - + 10 client-1]
         set id1 [lindex $pending 0 0]
@@ -7,12 +7,12 @@ start_server {tags {"zset"}} {
     }
 
     proc basics {encoding} {
-        if {$encoding == "ziplist"} {
-            r config set zset-max-ziplist-entries 128
-            r config set zset-max-ziplist-value 64
+        if {$encoding == "listpack"} {
+            r config set zset-max-listpack-entries 128
+            r config set zset-max-listpack-value 64
         } elseif {$encoding == "skiplist"} {
-            r config set zset-max-ziplist-entries 0
-            r config set zset-max-ziplist-value 0
+            r config set zset-max-listpack-entries 0
+            r config set zset-max-listpack-value 0
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -843,7 +843,7 @@ start_server {tags {"zset"}} {
         }
     }
 
-    basics ziplist
+    basics listpack
     basics skiplist
 
     test {ZINTERSTORE regression with two sets, intset+hashtable} {
@@ -859,7 +859,7 @@ start_server {tags {"zset"}} {
         r zrange out 0 -1 withscores
     } {neginf 0}
 
-    test {ZINTERSTORE #516 regression, mixed sets and ziplist zsets} {
+    test {ZINTERSTORE #516 regression, mixed sets and listpack zsets} {
         r sadd one 100 101 102 103
         r sadd two 100 200 201 202
         r zadd three 1 500 1 501 1 502 1 503 1 100
@@ -932,14 +932,14 @@ start_server {tags {"zset"}} {
     }
 
     proc stressers {encoding} {
-        if {$encoding == "ziplist"} {
+        if {$encoding == "listpack"} {
             # Little extra to allow proper fuzzing in the sorting stresser
-            r config set zset-max-ziplist-entries 256
-            r config set zset-max-ziplist-value 64
+            r config set zset-max-listpack-entries 256
+            r config set zset-max-listpack-value 64
             set elements 128
         } elseif {$encoding == "skiplist"} {
-            r config set zset-max-ziplist-entries 0
-            r config set zset-max-ziplist-value 0
+            r config set zset-max-listpack-entries 0
+            r config set zset-max-listpack-value 0
             if {$::accurate} {set elements 1000} else {set elements 100}
         } else {
             puts "Unknown sorted set encoding"
@@ -1359,13 +1359,13 @@ start_server {tags {"zset"}} {
     }
 
     tags {"slow"} {
-        stressers ziplist
+        stressers listpack
         stressers skiplist
     }
 
     test {ZSET skiplist order consistency when elements are moved} {
-        set original_max [lindex [r config get zset-max-ziplist-entries] 1]
-        r config set zset-max-ziplist-entries 0
+        set original_max [lindex [r config get zset-max-listpack-entries] 1]
+        r config set zset-max-listpack-entries 0
         for {set times 0} {$times < 10} {incr times} {
             r del zset
             for {set j 0} {$j < 1000} {incr j} {
@@ -1386,6 +1386,6 @@ start_server {tags {"zset"}} {
                 set prev_score $score
             }
         }
-        r config set zset-max-ziplist-entries $original_max
+        r config set zset-max-listpack-entries $original_max
     }
 }
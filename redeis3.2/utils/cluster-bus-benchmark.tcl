@@ -0,0 +1,111 @@
+#!/usr/bin/env tclsh8.5
+# Released under the BSD license like Redis itself
+#
+# Cluster bus benchmark: start many local cluster nodes, and measure the
+# bandwidth used by the cluster bus and the CPU used by every node, first
+# with full PING/PONG messages and then with the compact ones.
+#
+# Usage: tclsh cluster-bus-benchmark.tcl [nodes] [seconds] [base-port]
+#
+# All the nodes are masters and the slots are split among them. Since there
+# is no traffic, the CPU used by a node is the one spent in clusterCron()
+# and in processing the cluster bus messages. Every node uses two file
+# descriptors for every other node, so "ulimit -n" must be large enough.
+# The nodes and their files (under /tmp) are removed at exit.
+
+source [file join [file dirname [info script]] ../tests/support/redis.tcl]
+
+set numnodes [expr {[llength $argv] > 0 ? [lindex $argv 0] : 200}]
+set seconds [expr {[llength $argv] > 1 ? [lindex $argv 1] : 20}]
+set baseport [expr {[llength $argv] > 2 ? [lindex $argv 2] : 32000}]
+
+set server [file normalize \
+    [file join [file dirname [info script]] ../src/redis-server]]
+set dir [file join /tmp cluster-bus-benchmark-[pid]]
+file mkdir $dir
+
+proc cleanup {} {
+    foreach r $::links {
+        catch {$r shutdown nosave}
+    }
+    file delete -force $::dir
+}
+
+puts "Starting $numnodes nodes..."
+set links {}
+for {set j 0} {$j < $numnodes} {incr j} {
+    set port [expr {$baseport+$j}]
+    exec $server --port $port --cluster-enabled yes \
+        --cluster-config-file nodes-$port.conf --dir $dir \
+        --logfile $dir/redis-$port.log --daemonize yes \
+        --save "" --appendonly no --cluster-node-timeout 15000
+}
+for {set j 0} {$j < $numnodes} {incr j} {
+    set port [expr {$baseport+$j}]
+    while {[catch {redis 127.0.0.1 $port} r]} {after 10}
+    while {[catch {$r ping}]} {after 10}
+    lappend links $r
+}
+
+if {[catch {
+    puts "Joining the cluster and assigning the slots..."
+    set first [lindex $links 0]
+    for {set j 1} {$j < $numnodes} {incr j} {
+        $first cluster meet 127.0.0.1 [expr {$baseport+$j}]
+    }
+    for {set j 0} {$j < $numnodes} {incr j} {
+        set slots {}
+        for {set slot $j} {$slot < 16384} {incr slot $numnodes} {
+            lappend slots $slot
+        }
+        [lindex $links $j] cluster addslots {*}$slots
+    }
+    puts "Waiting for the cluster to be ok..."
+    foreach r $links {
+        while {![string match {*cluster_state:ok*} [$r cluster info]]} {
+            after 100
+        }
+    }
+
+    proc field {info name} {
+        if {[regexp "\n$name:(\[0-9.\]+)" "\n$info" - value]} {
+            return $value
+        }
+        return 0
+    }
+
+    # Return the total bus bytes sent and CPU time used by the nodes.
+    proc snapshot {} {
+        set bytes 0
+        set cpu 0
+        foreach r $::links {
+            set bytes [expr {$bytes+[field [$r cluster info] \
+                cluster_stats_bytes_sent]}]
+            set info [$r info cpu]
+            set cpu [expr {$cpu+[field $info used_cpu_sys]+
+                                [field $info used_cpu_user]}]
+        }
+        list $bytes $cpu
+    }
+
+    foreach compact {no yes} {
+        foreach r $links {
+            $r config set cluster-compact-bus $compact
+        }
+        # Let the links switch format.
+        after 5000
+        lassign [snapshot] bytes cpu
+        set start [clock milliseconds]
+        after [expr {$seconds*1000}]
+        lassign [snapshot] bytes2 cpu2
+        set elapsed [expr {([clock milliseconds]-$start)/1000.0}]
+
+        puts [format "cluster-compact-bus %-3s: %.0f bus bytes/sec per node, %.2f%% CPU per node" \
+            $compact \
+            [expr {($bytes2-$bytes)/$elapsed/$numnodes}] \
+            [expr {($cpu2-$cpu)*100/$elapsed/$numnodes}]]
+    }
+} e]} {
+    puts $e
+}
+cleanup
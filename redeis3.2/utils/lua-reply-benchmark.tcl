@@ -0,0 +1,57 @@
+#!/usr/bin/env tclsh8.5
+# Released under the BSD license like Redis itself
+#
+# Scripting benchmark: measure the cost of redis.call() for commands with
+# small and large replies, that are converted into Lua values.
+#
+# Usage: tclsh lua-reply-benchmark.tcl [host] [port] [calls] [elements]
+#
+# The server must already be running, and its current database is flushed.
+# For every script the time spent by the server inside EVALSHA is reported
+# (INFO commandstats), so the network round trip is not measured.
+
+source [file join [file dirname [info script]] ../tests/support/redis.tcl]
+
+set host [expr {[llength $argv] > 0 ? [lindex $argv 0] : "127.0.0.1"}]
+set port [expr {[llength $argv] > 1 ? [lindex $argv 1] : 6379}]
+set calls [expr {[llength $argv] > 2 ? [lindex $argv 2] : 2000}]
+set elements [expr {[llength $argv] > 3 ? [lindex $argv 3] : 1000}]
+
+set r [redis $host $port]
+$r flushdb
+puts "Creating keys with $elements elements..."
+for {set j 0} {$j < $elements} {incr j} {
+    $r hset bench:hash field:$j value:$j
+    $r rpush bench:list value:$j
+    $r zadd bench:zset $j member:$j
+}
+$r set bench:string [string repeat x 100]
+$r set bench:counter 0
+
+set scripts {
+    "HGETALL"           {return #redis.call('hgetall','bench:hash')}
+    "LRANGE 0 -1"       {return #redis.call('lrange','bench:list',0,-1)}
+    "ZRANGE WITHSCORES" {return #redis.call('zrange','bench:zset',0,-1,'withscores')}
+    "100 x GET"         {for i=1,100 do redis.call('get','bench:string') end}
+    "100 x INCR"        {for i=1,100 do redis.call('incr','bench:counter') end}
+}
+
+foreach {name script} $scripts {
+    set sha [$r script load $script]
+    $r config resetstat
+    set start [clock milliseconds]
+    for {set j 0} {$j < $calls} {incr j} {
+        $r evalsha $sha 0
+    }
+    set elapsed [expr {max(1,[clock milliseconds]-$start)}]
+
+    set usec_per_call 0
+    foreach line [split [$r info commandstats] "\r\n"] {
+        if {[regexp {^cmdstat_evalsha:.*usec_per_call=([0-9.]+)} $line - u]} {
+            set usec_per_call $u
+        }
+    }
+    puts [format "%-20s %8.1f usec per script (%.0f scripts/sec)" \
+        $name $usec_per_call [expr {$calls*1000.0/$elapsed}]]
+}
+$r flushdb
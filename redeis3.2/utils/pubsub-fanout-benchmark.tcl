@@ -0,0 +1,80 @@
+#!/usr/bin/env tclsh8.5
+# Released under the BSD license like Redis itself
+#
+# Pub/Sub fan-out benchmark: subscribe many clients to a single channel and
+# measure how many messages per second PUBLISH can deliver to all of them.
+#
+# Usage: tclsh pubsub-fanout-benchmark.tcl [host] [port] [subscribers]
+#                                          [messages] [size]
+#
+# The server must already be running. Compare runs with "io-threads 1" and
+# with "io-threads <n>" to see the effect of the threaded fan-out. Make sure
+# the file descriptors limit ("ulimit -n") allows for the subscribers.
+#
+# Two numbers are reported: the PUBLISH rate seen by the client, and the
+# time spent by the server inside PUBLISH (INFO commandstats), that is the
+# fan-out cost without the socket writes.
+
+source [file join [file dirname [info script]] ../tests/support/redis.tcl]
+
+set host [expr {[llength $argv] > 0 ? [lindex $argv 0] : "127.0.0.1"}]
+set port [expr {[llength $argv] > 1 ? [lindex $argv 1] : 6379}]
+set numsub [expr {[llength $argv] > 2 ? [lindex $argv 2] : 10000}]
+set messages [expr {[llength $argv] > 3 ? [lindex $argv 3] : 1000}]
+set size [expr {[llength $argv] > 4 ? [lindex $argv 4] : 64}]
+
+# The subscribers are drained polling their non blocking sockets, since the
+# Tcl event loop can't wait for more than FD_SETSIZE descriptors.
+set ::received 0
+set ::subscribers {}
+proc drain {} {
+    foreach fd $::subscribers {
+        incr ::received [string length [read $fd]]
+    }
+}
+
+set r [redis $host $port]
+puts "Subscribing $numsub clients..."
+for {set j 0} {$j < $numsub} {incr j} {
+    set fd [socket $host $port]
+    fconfigure $fd -translation binary -blocking 0
+    puts -nonewline $fd "SUBSCRIBE fanout-bench\r\n"
+    flush $fd
+    lappend ::subscribers $fd
+}
+while {[lindex [$r pubsub numsub fanout-bench] 1] < $numsub} {
+    after 10
+}
+drain
+
+set payload [string repeat x $size]
+set msglen [string length \
+    "*3\r\n\$7\r\nmessage\r\n\$12\r\nfanout-bench\r\n\$$size\r\n$payload\r\n"]
+set expected [expr {$::received+$numsub*$messages*$msglen}]
+$r config resetstat
+puts "Publishing $messages messages of $size bytes..."
+set start [clock milliseconds]
+for {set j 0} {$j < $messages} {incr j} {
+    $r publish fanout-bench $payload
+    if {$j % 10 == 9} drain
+}
+set elapsed [expr {max(1,[clock milliseconds]-$start)}]
+
+# Wait for the subscribers to receive everything.
+set deadline [expr {[clock milliseconds]+60000}]
+while {$::received < $expected && [clock milliseconds] < $deadline} {
+    drain
+}
+set total [expr {max(1,[clock milliseconds]-$start)}]
+
+set usec_per_call 0
+foreach line [split [$r info commandstats] "\r\n"] {
+    if {[regexp {^cmdstat_publish:.*usec_per_call=([0-9.]+)} $line - u]} {
+        set usec_per_call $u
+    }
+}
+puts [format "io-threads: %s" [lindex [$r config get io-threads] 1]]
+puts [format "PUBLISH rate: %.0f messages/sec (%.0f deliveries/sec)" \
+    [expr {$messages*1000.0/$elapsed}] \
+    [expr {$messages*$numsub*1000.0/$total}]]
+puts [format "Server time per PUBLISH: %.1f usec" $usec_per_call]
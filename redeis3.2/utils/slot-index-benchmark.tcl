@@ -0,0 +1,91 @@
+#!/usr/bin/env tclsh8.5
+# Released under the BSD license like Redis itself
+#
+# Cluster keyspace benchmark: measure the overhead of the slot -> keys index
+# on writes, and its memory cost per key.
+#
+# Usage: tclsh slot-index-benchmark.tcl [host] [port] [keys]
+#
+# The server must already be running with cluster-enabled yes, and its
+# database is flushed. If the cluster is not up, all the slots are added to
+# the node. Run it against servers built from different versions to compare
+# the indexes: the time spent by the server in every command is reported
+# (INFO commandstats), so the network round trip is not measured.
+
+source [file join [file dirname [info script]] ../tests/support/redis.tcl]
+
+set host [expr {[llength $argv] > 0 ? [lindex $argv 0] : "127.0.0.1"}]
+set port [expr {[llength $argv] > 1 ? [lindex $argv 1] : 6379}]
+set numkeys [expr {[llength $argv] > 2 ? [lindex $argv 2] : 100000}]
+
+proc field {text field} {
+    foreach line [split $text "\r\n"] {
+        if {[regexp "^$field:(.*)" $line - value]} {return $value}
+    }
+    return {}
+}
+
+proc usec_per_call {r cmd} {
+    set value [field [$r info commandstats] "cmdstat_$cmd"]
+    if {[regexp {usec_per_call=([0-9.]+)} $value - u]} {return $u}
+    return 0
+}
+
+proc format_command {args} {
+    set cmd "*[llength $args]\r\n"
+    foreach a $args {append cmd "\$[string length $a]\r\n$a\r\n"}
+    return $cmd
+}
+
+# Run 'cmd' against 'numkeys' keys named prefix:<n>, in pipelines of 1000
+# commands. Returns the usec per call and the commands per second.
+proc pipeline {r cmd prefix numkeys args} {
+    $r config resetstat
+    $r deferred 1
+    set start [clock milliseconds]
+    for {set j 0} {$j < $numkeys} {incr j 1000} {
+        set n [expr {min(1000,$numkeys-$j)}]
+        for {set k 0} {$k < $n} {incr k} {
+            $r write [format_command $cmd $prefix:[expr {$j+$k}] {*}$args]
+        }
+        $r flush
+        for {set k 0} {$k < $n} {incr k} {$r read}
+    }
+    set elapsed [expr {max(1,[clock milliseconds]-$start)}]
+    $r deferred 0
+    return [list [usec_per_call $r [string tolower $cmd]] \
+                 [expr {$numkeys*1000.0/$elapsed}]]
+}
+
+proc report {name result} {
+    lassign $result usec ops
+    puts [format "%-24s %8.3f usec per call (%.0f ops/sec)" $name $usec $ops]
+}
+
+set r [redis $host $port]
+if {[field [$r info cluster] cluster_enabled] != 1} {
+    puts "The server must be started with cluster-enabled yes"
+    exit 1
+}
+if {[field [$r cluster info] cluster_state] ne {ok}} {
+    set slots {}
+    for {set j 0} {$j < 16384} {incr j} {lappend slots $j}
+    catch {$r cluster addslots {*}$slots}
+    while {[field [$r cluster info] cluster_state] ne {ok}} {after 100}
+}
+$r flushall
+
+set mem_before [field [$r info memory] used_memory]
+report "SET new keys" [pipeline $r SET key $numkeys 1]
+set mem_after [field [$r info memory] used_memory]
+report "INCRBY existing keys" [pipeline $r INCRBY key $numkeys 1]
+report "SADD new keys" [pipeline $r SADD set $numkeys member]
+report "DEL keys" [pipeline $r DEL key $numkeys]
+
+$r config resetstat
+for {set j 0} {$j < 1000} {incr j} {$r cluster getkeysinslot $j 100}
+puts [format "%-24s %8.3f usec per call" "CLUSTER GETKEYSINSLOT" \
+    [usec_per_call $r cluster]]
+puts [format "%-24s %8.1f bytes" "Memory per key" \
+    [expr {($mem_after-$mem_before)/double($numkeys)}]]
+$r flushall